@@ -1,6 +1,13 @@
 // ambulance_dispatch.cpp
-// Compile: g++ -std=c++17 -O2 -o ambulance_dispatch ambulance_dispatch.cpp
-// Usage: ./ambulance_dispatch incidents.csv
+// Compile: g++ -std=c++17 -O2 -pthread -o ambulance_dispatch ambulance_dispatch.cpp
+// Usage: ./ambulance_dispatch incidents.csv [--index grid|scan] [--fleet N]
+//        ./ambulance_dispatch incidents.csv --simulate [--fleet N] [--speed m/s] [--onscene s]
+//        ./ambulance_dispatch --synthetic N [--days D] [--hotspots H] --simulate ...
+//        batch mode: --batch-window S [--candidates K] [--threads T] (with or without --simulate)
+//        pre-positioning (--simulate/--sweep): --reposition S [--heat-grid G] [--heat-bandwidth m]
+//                           [--heat-halflife s] [--cover-radius m] [--max-move m] [--gap-share f]
+//        ./ambulance_dispatch incidents.csv --sweep 100,200,400 [--placements P] [--seed S] [--threads T]
+//        ./ambulance_dispatch --bench [fleet=100000] [queries=10000]
 #include <bits/stdc++.h>
 using namespace std;
 
@@ -32,71 +39,1352 @@ struct IncidentComparator {
     }
 };
 
-double euclidDist(const Incident &ins, const Ambulance &amb) {
-    double dx = ins.x - amb.x;
-    double dy = ins.y - amb.y;
-    return sqrt(dx*dx + dy*dy);
+// Dynamic spatial index over the *available* ambulances.
+// Uniform grid: each cell keeps a small array of (x, y, ambulance index) entries.
+// remove()/insert() are O(1) (swap-with-last inside the cell), nearest() scans
+// square rings of cells around the query and stops as soon as no unscanned ring
+// can hold anything closer than the best candidate found so far.
+struct AmbulanceGrid {
+    struct Entry { double x, y; int idx; };
+
+    double minX = 0, minY = 0, cellSize = 1;
+    int cols = 1, rows = 1;
+    vector<vector<Entry>> cells;
+    vector<int> cellOf;   // per ambulance: cell it sits in, -1 if not indexed
+    vector<int> slotOf;   // per ambulance: position inside cells[cellOf]
+    size_t count = 0;
+
+    // Size the grid for the given extent so that a cell holds ~perCell ambulances
+    // when the whole fleet is available.
+    void init(size_t fleet, double x0, double y0, double x1, double y1, double perCell = 2.0) {
+        minX = x0; minY = y0;
+        double w = max(x1 - x0, 1e-9), h = max(y1 - y0, 1e-9);
+        double targetCells = max(1.0, (double)fleet / perCell);
+        cellSize = sqrt(w * h / targetCells);
+        cols = max(1, (int)ceil(w / cellSize));
+        rows = max(1, (int)ceil(h / cellSize));
+        cells.assign((size_t)cols * rows, {});
+        cellOf.assign(fleet, -1);
+        slotOf.assign(fleet, -1);
+        count = 0;
+    }
+
+    int cellX(double x) const { return min(cols - 1, max(0, (int)floor((x - minX) / cellSize))); }
+    int cellY(double y) const { return min(rows - 1, max(0, (int)floor((y - minY) / cellSize))); }
+
+    bool contains(int i) const { return cellOf[i] >= 0; }
+
+    void insert(int i, double x, double y) {
+        if (cellOf[i] >= 0) return;
+        int c = cellY(y) * cols + cellX(x);
+        cellOf[i] = c;
+        slotOf[i] = (int)cells[c].size();
+        cells[c].push_back({x, y, i});
+        ++count;
+    }
+
+    void remove(int i) {
+        int c = cellOf[i];
+        if (c < 0) return;
+        vector<Entry> &cell = cells[c];
+        int s = slotOf[i];
+        cell[s] = cell.back();
+        slotOf[cell[s].idx] = s;
+        cell.pop_back();
+        cellOf[i] = -1;
+        slotOf[i] = -1;
+        --count;
+    }
+
+    // Nearest indexed ambulance to (x, y); returns -1 if the index is empty.
+    // Ties are broken by the lower ambulance index, matching the linear scan.
+    int nearest(double x, double y, double &bestDist) const {
+        bestDist = numeric_limits<double>::infinity();
+        if (count == 0) return -1;
+        int cx = cellX(x), cy = cellY(y);
+        int maxR = max(max(cx, cols - 1 - cx), max(cy, rows - 1 - cy));
+        double best2 = numeric_limits<double>::infinity();
+        int bestIdx = -1;
+        auto scanCell = [&](int gx, int gy) {
+            for (const Entry &e : cells[(size_t)gy * cols + gx]) {
+                double dx = x - e.x, dy = y - e.y;
+                double d2 = dx*dx + dy*dy;
+                if (d2 < best2 || (d2 == best2 && e.idx < bestIdx)) { best2 = d2; bestIdx = e.idx; }
+            }
+        };
+        for (int r = 0; r <= maxR; ++r) {
+            // Anything in ring r is at least (r-1)*cellSize away from the query.
+            if (bestIdx != -1) {
+                double bound = (r - 1) * cellSize;
+                if (bound > 0 && bound * bound > best2) break;
+            }
+            int x0 = cx - r, x1 = cx + r, y0 = cy - r, y1 = cy + r;
+            for (int gx = max(x0, 0); gx <= min(x1, cols - 1); ++gx) {
+                if (y0 >= 0) scanCell(gx, y0);
+                if (y1 < rows && y1 != y0) scanCell(gx, y1);
+            }
+            for (int gy = max(y0 + 1, 0); gy <= min(y1 - 1, rows - 1); ++gy) {
+                if (x0 >= 0) scanCell(x0, gy);
+                if (x1 < cols && x1 != x0) scanCell(x1, gy);
+            }
+        }
+        if (bestIdx != -1) bestDist = sqrt(best2);
+        return bestIdx;
+    }
+
+    // Up to k nearest indexed ambulances as (distance, index), closest first.
+    void kNearest(double x, double y, int k, vector<pair<double,int>> &out) const {
+        out.clear();
+        if (count == 0 || k <= 0) return;
+        int cx = cellX(x), cy = cellY(y);
+        int maxR = max(max(cx, cols - 1 - cx), max(cy, rows - 1 - cy));
+        // max-heap of (squared distance, index) holding the k best so far
+        auto scanCell = [&](int gx, int gy) {
+            for (const Entry &e : cells[(size_t)gy * cols + gx]) {
+                double dx = x - e.x, dy = y - e.y;
+                pair<double,int> cand(dx*dx + dy*dy, e.idx);
+                if ((int)out.size() < k) {
+                    out.push_back(cand);
+                    push_heap(out.begin(), out.end());
+                } else if (cand < out.front()) {
+                    pop_heap(out.begin(), out.end());
+                    out.back() = cand;
+                    push_heap(out.begin(), out.end());
+                }
+            }
+        };
+        for (int r = 0; r <= maxR; ++r) {
+            if ((int)out.size() == k) {
+                double bound = (r - 1) * cellSize;
+                if (bound > 0 && bound * bound > out.front().first) break;
+            }
+            int x0 = cx - r, x1 = cx + r, y0 = cy - r, y1 = cy + r;
+            for (int gx = max(x0, 0); gx <= min(x1, cols - 1); ++gx) {
+                if (y0 >= 0) scanCell(gx, y0);
+                if (y1 < rows && y1 != y0) scanCell(gx, y1);
+            }
+            for (int gy = max(y0 + 1, 0); gy <= min(y1 - 1, rows - 1); ++gy) {
+                if (x0 >= 0) scanCell(x0, gy);
+                if (x1 < cols && x1 != x0) scanCell(x1, gy);
+            }
+        }
+        sort_heap(out.begin(), out.end());
+        for (auto &p : out) p.first = sqrt(p.first);
+    }
+
+    void buildFrom(const vector<Ambulance> &ambs, double x0, double y0, double x1, double y1) {
+        init(ambs.size(), x0, y0, x1, y1);
+        for (size_t i = 0; i < ambs.size(); ++i)
+            if (ambs[i].available) insert((int)i, ambs[i].x, ambs[i].y);
+    }
+};
+
+// Reference implementation: linear scan over all ambulances.
+int nearestAvailableScan(const vector<Ambulance> &ambulances, double x, double y, double &bestDist) {
+    bestDist = numeric_limits<double>::infinity();
+    int bestIdx = -1;
+    for (size_t i = 0; i < ambulances.size(); ++i) {
+        if (!ambulances[i].available) continue;
+        double dx = x - ambulances[i].x, dy = y - ambulances[i].y;
+        double d = sqrt(dx*dx + dy*dy);
+        if (d < bestDist) {
+            bestDist = d;
+            bestIdx = (int)i;
+        }
+    }
+    return bestIdx;
+}
+
+// Benchmark: the same dispatch/release sequence run against the linear scan and
+// the grid index. Each query dispatches its nearest ambulance; after every query
+// one random busy ambulance is released, so roughly half the fleet stays busy.
+int runIndexBenchmark(int fleet, int queries) {
+    std::mt19937 rng(2024);
+    std::uniform_real_distribution<double> distXY(0.0, 100000.0);
+    vector<Ambulance> base(fleet);
+    for (int i = 0; i < fleet; ++i) {
+        base[i].id = "AMB" + to_string(i+1);
+        base[i].x = distXY(rng);
+        base[i].y = distXY(rng);
+        base[i].available = true;
+    }
+    vector<pair<double,double>> qs(queries);
+    for (auto &q : qs) q = {distXY(rng), distXY(rng)};
+    // Pre-draw the release choices so both runs see identical sequences.
+    vector<uint32_t> releaseDraw(queries);
+    for (auto &r : releaseDraw) r = rng();
+
+    auto run = [&](bool useGrid, vector<int> &picked) {
+        vector<Ambulance> ambs = base;
+        AmbulanceGrid grid;
+        if (useGrid) grid.buildFrom(ambs, 0.0, 0.0, 100000.0, 100000.0);
+        vector<int> busy;
+        busy.reserve(fleet);
+        picked.assign(queries, -1);
+        auto t0 = chrono::high_resolution_clock::now();
+        for (int q = 0; q < queries; ++q) {
+            double d;
+            int idx = useGrid ? grid.nearest(qs[q].first, qs[q].second, d)
+                              : nearestAvailableScan(ambs, qs[q].first, qs[q].second, d);
+            picked[q] = idx;
+            if (idx >= 0) {
+                ambs[idx].available = false;
+                if (useGrid) grid.remove(idx);
+                busy.push_back(idx);
+            }
+            if (busy.size() > (size_t)fleet / 2) {
+                size_t k = releaseDraw[q] % busy.size();
+                int r = busy[k];
+                busy[k] = busy.back(); busy.pop_back();
+                ambs[r].available = true;
+                if (useGrid) grid.insert(r, ambs[r].x, ambs[r].y);
+            }
+        }
+        auto t1 = chrono::high_resolution_clock::now();
+        return chrono::duration<double>(t1 - t0).count();
+    };
+
+    cout << "Benchmark: fleet=" << fleet << " queries=" << queries << "\n";
+    vector<int> pickScan, pickGrid;
+    double tScan = run(false, pickScan);
+    double tGrid = run(true, pickGrid);
+    size_t mismatches = 0;
+    for (int q = 0; q < queries; ++q) if (pickScan[q] != pickGrid[q]) ++mismatches;
+    cout << fixed << setprecision(3);
+    cout << "  scan: " << tScan * 1e3 << " ms (" << (tScan * 1e9 / max(1, queries)) << " ns/query)\n";
+    cout << "  grid: " << tGrid * 1e3 << " ms (" << (tGrid * 1e9 / max(1, queries)) << " ns/query)\n";
+    cout << "  speedup: " << (tGrid > 0 ? tScan / tGrid : 0.0) << "x, mismatches: " << mismatches << "\n";
+    return mismatches == 0 ? 0 : 1;
+}
+
+// ------------------------- Input helpers -------------------------------
+
+// Read incidents CSV (incident_id,severity,x,y,timestamp). Returns false if the file can't be opened.
+bool loadIncidentsCsv(const string &filename, vector<Incident> &incidents) {
+    ifstream fin(filename);
+    if (!fin) return false;
+    string header;
+    getline(fin, header); // skip header
+    string line;
+    while (getline(fin, line)) {
+        if (line.empty()) continue;
+        stringstream ss(line);
+        string id, sev_s, x_s, y_s, ts_s;
+        // CSV: incident_id,severity,x,y,timestamp
+        getline(ss, id, ',');
+        getline(ss, sev_s, ',');
+        getline(ss, x_s, ',');
+        getline(ss, y_s, ',');
+        getline(ss, ts_s, ',');
+        Incident ins;
+        ins.id = id;
+        ins.severity = stoi(sev_s);
+        ins.x = stod(x_s);
+        ins.y = stod(y_s);
+        ins.timestamp = stol(ts_s);
+        incidents.push_back(ins);
+    }
+    return true;
+}
+
+// Ambulances uniformly distributed over the 100km x 100km service area.
+// In production, read from CSV / DB.
+vector<Ambulance> generateFleet(int numAmb, uint32_t seed) {
+    vector<Ambulance> ambulances;
+    ambulances.reserve(numAmb);
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> distXY(0.0, 100000.0);
+    for (int i = 0; i < numAmb; ++i) {
+        Ambulance a;
+        a.id = "AMB" + to_string(i+1);
+        a.x = distXY(rng);
+        a.y = distXY(rng);
+        a.available = true;
+        ambulances.push_back(a);
+    }
+    return ambulances;
+}
+
+// Synthetic incident log: n incidents spread uniformly over `days` days, for load testing.
+// With hotspots > 0, half of the incidents cluster around that many random centres
+// (Gaussian, sigma 4 km) so demand is uneven.
+vector<Incident> generateSyntheticIncidents(size_t n, int days, uint32_t seed, int hotspots = 0) {
+    vector<Incident> incidents(n);
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> distXY(0.0, 100000.0);
+    std::normal_distribution<double> jitter(0.0, 4000.0);
+    vector<pair<double,double>> centres(max(0, hotspots));
+    for (auto &c : centres) c = {distXY(rng), distXY(rng)};
+    std::uniform_int_distribution<int> distSev(1, 5);
+    std::uniform_int_distribution<long> distTs(0, (long)days * 86400 - 1);
+    for (size_t i = 0; i < n; ++i) {
+        incidents[i].id = "SYN" + to_string(i+1);
+        incidents[i].severity = distSev(rng);
+        incidents[i].x = distXY(rng);
+        incidents[i].y = distXY(rng);
+        if (!centres.empty() && (i & 1)) {
+            const auto &c = centres[rng() % centres.size()];
+            incidents[i].x = min(100000.0, max(0.0, c.first + jitter(rng)));
+            incidents[i].y = min(100000.0, max(0.0, c.second + jitter(rng)));
+        }
+        incidents[i].timestamp = 1700000000L + distTs(rng);
+    }
+    return incidents;
+}
+
+// Incident indices in timestamp order (stable, so ties keep file order).
+vector<int> arrivalOrder(const vector<Incident> &incidents) {
+    vector<int> order(incidents.size());
+    iota(order.begin(), order.end(), 0);
+    stable_sort(order.begin(), order.end(), [&](int a, int b) { return incidents[a].timestamp < incidents[b].timestamp; });
+    return order;
+}
+
+double percentile(vector<double> v, double p) {
+    if (v.empty()) return 0.0;
+    size_t k = (size_t)min((double)v.size() - 1, floor(p / 100.0 * (v.size() - 1) + 0.5));
+    nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k];
+}
+
+// ------------------------- Timer wheel ---------------------------------
+
+// Hierarchical timer wheel: 4 levels x 256 slots, 1 tick = 1 second of simulated time.
+// An event goes to the lowest level whose higher digits agree with `now`; when level 0
+// runs dry, the next occupied slot of a higher level is cascaded down. Events beyond
+// the 2^32-tick horizon wait in an overflow list. Events due at the same tick come
+// out in FIFO order. Nodes live in a pooled array linked by index.
+class TimerWheel {
+public:
+    static const int LEVELS = 4;
+    static const int BITS = 8;
+    static const int SLOTS = 1 << BITS;
+    static const uint64_t MASK = SLOTS - 1;
+
+    explicit TimerWheel(uint64_t start = 0) { reset(start); }
+
+    void reset(uint64_t start) {
+        now_ = start;
+        size_ = 0;
+        nodes_.clear();
+        free_.clear();
+        overflow_.clear();
+        for (int l = 0; l < LEVELS; ++l) {
+            for (int s = 0; s < SLOTS; ++s) head_[l][s] = tail_[l][s] = -1;
+            for (int w = 0; w < SLOTS / 64; ++w) bits_[l][w] = 0;
+        }
+    }
+
+    uint64_t now() const { return now_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    // Schedule `payload` at tick `when` (clamped to now).
+    void schedule(uint64_t when, uint32_t payload) {
+        int32_t n;
+        if (!free_.empty()) { n = free_.back(); free_.pop_back(); }
+        else { n = (int32_t)nodes_.size(); nodes_.push_back({}); }
+        nodes_[n] = {max(when, now_), payload, -1};
+        place(n);
+        ++size_;
+    }
+
+    // Pop the earliest event; advances now() to its tick.
+    bool pop(uint64_t &when, uint32_t &payload) {
+        if (size_ == 0) return false;
+        for (;;) {
+            int s = findSlot(0, (int)(now_ & MASK));
+            if (s >= 0) {
+                now_ = (now_ & ~MASK) | (uint64_t)s;
+                int32_t n = head_[0][s];
+                head_[0][s] = nodes_[n].next;
+                if (head_[0][s] < 0) { tail_[0][s] = -1; bits_[0][s >> 6] &= ~(1ULL << (s & 63)); }
+                when = nodes_[n].when;
+                payload = nodes_[n].payload;
+                free_.push_back(n);
+                --size_;
+                return true;
+            }
+            if (!cascade()) return false;
+        }
+    }
+
+    // True if another event is due at the current tick (no cascading needed:
+    // everything due at now() sits in its level-0 slot).
+    bool dueNow() const { return head_[0][now_ & MASK] >= 0; }
+
+private:
+    struct Node { uint64_t when; uint32_t payload; int32_t next; };
+
+    vector<Node> nodes_;
+    vector<int32_t> free_;
+    vector<int32_t> overflow_;
+    int32_t head_[LEVELS][SLOTS];
+    int32_t tail_[LEVELS][SLOTS];
+    uint64_t bits_[LEVELS][SLOTS / 64];
+    uint64_t now_ = 0;
+    size_t size_ = 0;
+
+    void append(int l, int s, int32_t n) {
+        nodes_[n].next = -1;
+        if (tail_[l][s] < 0) { head_[l][s] = n; bits_[l][s >> 6] |= 1ULL << (s & 63); }
+        else nodes_[tail_[l][s]].next = n;
+        tail_[l][s] = n;
+    }
+
+    void place(int32_t n) {
+        uint64_t t = nodes_[n].when;
+        for (int l = 0; l < LEVELS; ++l) {
+            int shift = BITS * (l + 1);
+            if ((t >> shift) == (now_ >> shift)) {
+                append(l, (int)((t >> (BITS * l)) & MASK), n);
+                return;
+            }
+        }
+        overflow_.push_back(n);
+    }
+
+    // First occupied slot >= from at level l, or -1.
+    int findSlot(int l, int from) const {
+        for (int w = from >> 6; w < SLOTS / 64; ++w) {
+            uint64_t m = bits_[l][w];
+            if (w == (from >> 6)) m &= ~0ULL << (from & 63);
+            if (m) return w * 64 + __builtin_ctzll(m);
+        }
+        return -1;
+    }
+
+    // Level 0 is exhausted for the current block: move now() to the start of the
+    // next occupied higher-level slot and redistribute its events downwards.
+    bool cascade() {
+        for (int l = 1; l < LEVELS; ++l) {
+            int shift = BITS * l;
+            int cur = (int)((now_ >> shift) & MASK);
+            int s = findSlot(l, cur + 1);
+            if (s < 0) continue;
+            now_ = ((now_ >> (shift + BITS)) << (shift + BITS)) | ((uint64_t)s << shift);
+            int32_t n = head_[l][s];
+            head_[l][s] = tail_[l][s] = -1;
+            bits_[l][s >> 6] &= ~(1ULL << (s & 63));
+            while (n >= 0) { int32_t nx = nodes_[n].next; place(n); n = nx; }
+            return true;
+        }
+        if (overflow_.empty()) return false;
+        uint64_t tmin = numeric_limits<uint64_t>::max();
+        for (int32_t n : overflow_) tmin = min(tmin, nodes_[n].when);
+        now_ = tmin;
+        vector<int32_t> pending;
+        pending.swap(overflow_);
+        for (int32_t n : pending) place(n);
+        return true;
+    }
+};
+
+// ------------------------- Thread pool ---------------------------------
+
+// Fixed-size worker pool. submit() queues a task and returns its future;
+// parallelFor() splits [0, n) into contiguous chunks and waits for all of them.
+// Do not call parallelFor() from inside a pool task (it would wait on itself).
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned n) {
+        n = max(1u, n);
+        for (unsigned i = 0; i < n; ++i) workers_.emplace_back([this] { workerLoop(); });
+    }
+    ~ThreadPool() {
+        {
+            lock_guard<mutex> lg(mtx_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        for (auto &t : workers_) t.join();
+    }
+    size_t size() const { return workers_.size(); }
+
+    template <class F>
+    auto submit(F f) -> future<decltype(f())> {
+        auto task = make_shared<packaged_task<decltype(f())()>>(move(f));
+        future<decltype(f())> fut = task->get_future();
+        {
+            lock_guard<mutex> lg(mtx_);
+            tasks_.emplace_back([task] { (*task)(); });
+        }
+        cv_.notify_one();
+        return fut;
+    }
+
+    void parallelFor(size_t n, const function<void(size_t, size_t)> &body) {
+        size_t chunks = min(n, workers_.size());
+        if (chunks <= 1) { if (n) body(0, n); return; }
+        vector<future<void>> futs;
+        futs.reserve(chunks);
+        for (size_t c = 0; c < chunks; ++c) {
+            size_t lo = n * c / chunks, hi = n * (c + 1) / chunks;
+            futs.push_back(submit([&body, lo, hi] { body(lo, hi); }));
+        }
+        for (auto &f : futs) f.get();
+    }
+
+private:
+    vector<thread> workers_;
+    deque<function<void()>> tasks_;
+    mutex mtx_;
+    condition_variable cv_;
+    bool stop_ = false;
+
+    void workerLoop() {
+        for (;;) {
+            function<void()> task;
+            {
+                unique_lock<mutex> lk(mtx_);
+                cv_.wait(lk, [this] { return stop_ || !tasks_.empty(); });
+                if (stop_ && tasks_.empty()) return;
+                task = move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+};
+
+// ------------------------- Batched assignment --------------------------
+
+// Sparse assignment problem: person i may take any object in its candidate list
+// cand[start[i] .. start[i+1]) at cost cost[...], or its private "dummy" object at
+// dummyCost (meaning: left unassigned). Solved exactly by successive shortest
+// augmenting paths with object potentials (Hungarian / Jonker-Volgenant style):
+// for each person, Dijkstra over reduced costs until a free object (or the dummy)
+// is reached, then potentials are updated and the path is flipped.
+struct AssignResult {
+    vector<int> objOf;   // per person: object, or -1 for dummy
+    size_t scanned = 0;  // Dijkstra pops over all augmentations
+};
+
+AssignResult assignMinCost(int n, int m, const vector<int> &start, const vector<int> &cand,
+                           const vector<double> &cost, double dummyCost) {
+    const int DUMMY = -1;
+    const double INF = numeric_limits<double>::infinity();
+    AssignResult res;
+    res.objOf.assign(n, DUMMY);
+    vector<double> v(m, 0.0);           // object potentials
+    vector<int> owner(m, -1);
+    vector<double> ownCost(n, 0.0);     // cost of each person's current edge
+    // Dijkstra state over m objects plus n private dummies (node m + i)
+    vector<double> dist(m + n, INF);
+    vector<int> pred(m + n, -1);
+    vector<char> done(m + n, 0);
+    vector<int> touched;
+    typedef pair<double,int> QE;
+    priority_queue<QE, vector<QE>, greater<QE>> heap;
+
+    for (int s = 0; s < n; ++s) {
+        auto relax = [&](int x, double d, int from) {
+            // Finalized nodes are never reopened: rounding can make a reduced cost
+            // slightly negative, and re-labelling would corrupt the predecessor tree.
+            if (!done[x] && d < dist[x]) {
+                if (dist[x] == INF) touched.push_back(x);
+                dist[x] = d;
+                pred[x] = from;
+                heap.push({d, x});
+            }
+        };
+        for (int e = start[s]; e < start[s + 1]; ++e) relax(cand[e], cost[e] - v[cand[e]], s);
+        relax(m + s, dummyCost, s);
+
+        int sink = -1;
+        double D = 0;
+        vector<int> finalized;
+        while (!heap.empty()) {
+            QE top = heap.top(); heap.pop();
+            int x = top.second;
+            if (done[x] || top.first > dist[x]) continue;
+            done[x] = 1;
+            ++res.scanned;
+            if (x >= m || owner[x] < 0) { sink = x; D = top.first; break; }
+            finalized.push_back(x);
+            int i = owner[x];
+            double ui = ownCost[i] - v[x];     // reduced cost of i's current edge is 0
+            for (int e = start[i]; e < start[i + 1]; ++e)
+                if (cand[e] != x) relax(cand[e], top.first + cost[e] - v[cand[e]] - ui, i);
+            relax(m + i, top.first + dummyCost - ui, i);
+        }
+        while (!heap.empty()) heap.pop();
+
+        for (int j : finalized) v[j] += dist[j] - D;
+
+        // Flip the augmenting path back to s.
+        int x = sink;
+        for (;;) {
+            int i = pred[x];
+            int prev = res.objOf[i];
+            if (x >= m) {
+                res.objOf[i] = DUMMY;
+                ownCost[i] = dummyCost;
+            } else {
+                owner[x] = i;
+                res.objOf[i] = x;
+                for (int e = start[i]; e < start[i + 1]; ++e) if (cand[e] == x) { ownCost[i] = cost[e]; break; }
+            }
+            if (i == s) break;
+            x = prev;
+        }
+        for (int t : touched) { dist[t] = INF; pred[t] = -1; done[t] = 0; }
+        touched.clear();
+    }
+    return res;
+}
+
+// Per-person candidate lists of (distance, ambulance index) renumbered into the
+// dense CSR layout assignMinCost() expects.
+struct CandidateGraph {
+    vector<int> start, cand;
+    vector<double> cost;
+    vector<int> globalOf;   // dense object id -> ambulance index
+    double maxCost = 0;
+};
+
+CandidateGraph buildCandidateGraph(const vector<vector<pair<double,int>>> &near) {
+    CandidateGraph g;
+    unordered_map<int,int> localOf;
+    g.start.assign(near.size() + 1, 0);
+    for (size_t i = 0; i < near.size(); ++i) {
+        for (auto &p : near[i]) {
+            auto it = localOf.find(p.second);
+            int j;
+            if (it == localOf.end()) { j = (int)g.globalOf.size(); localOf.emplace(p.second, j); g.globalOf.push_back(p.second); }
+            else j = it->second;
+            g.cand.push_back(j);
+            g.cost.push_back(p.first);
+            g.maxCost = max(g.maxCost, p.first);
+        }
+        g.start[i + 1] = (int)g.cand.size();
+    }
+    return g;
+}
+
+// Per-batch report for the batched dispatch mode.
+struct BatchReport {
+    size_t incidents = 0;
+    size_t candidates = 0;  // distinct ambulances considered
+    size_t assigned = 0;
+    size_t scanned = 0;     // shortest-path work (nodes popped)
+    double totalDist = 0;   // optimal assignment
+    double greedyDist = 0;  // what one-at-a-time greedy would have cost
+    double solveMs = 0;
+};
+
+// Assign a batch of incidents (already in priority order) to available ambulances,
+// minimising total distance. Candidates per incident are its `candK` nearest
+// available ambulances from the grid (found in parallel when a pool is given);
+// incidents left on their dummy fall back to greedy nearest. Assigned ambulances
+// are removed from the grid.
+// ambOf/distOf receive the ambulance index (-1 if none left) and distance per entry.
+void batchAssign(AmbulanceGrid &grid, const vector<Ambulance> &ambulances, const vector<Incident> &incidents,
+                 const vector<int> &batch, int candK, ThreadPool *pool, vector<int> &ambOf, vector<double> &distOf, BatchReport &rep) {
+    auto t0 = chrono::high_resolution_clock::now();
+    int n = (int)batch.size();
+    ambOf.assign(n, -1);
+    distOf.assign(n, -1.0);
+    rep = BatchReport();
+    rep.incidents = n;
+    if (n == 0 || grid.count == 0) return;
+
+    // Greedy baseline for the report: take, then put everything back.
+    {
+        vector<int> taken;
+        for (int i = 0; i < n; ++i) {
+            double d;
+            int a = grid.nearest(incidents[batch[i]].x, incidents[batch[i]].y, d);
+            if (a < 0) break;
+            rep.greedyDist += d;
+            taken.push_back(a);
+            grid.remove(a);
+        }
+        for (int a : taken) grid.insert(a, ambulances[a].x, ambulances[a].y);
+    }
+
+    // Candidate lists (k nearest per incident), in parallel when possible.
+    int k = min<int>(candK, (int)grid.count);
+    vector<vector<pair<double,int>>> near(n);
+    auto findCandidates = [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; ++i)
+            grid.kNearest(incidents[batch[i]].x, incidents[batch[i]].y, k, near[i]);
+    };
+    if (pool && n >= 256) pool->parallelFor(n, findCandidates);
+    else findCandidates(0, n);
+
+    CandidateGraph cg = buildCandidateGraph(near);
+    rep.candidates = cg.globalOf.size();
+
+    AssignResult ar = assignMinCost(n, (int)cg.globalOf.size(), cg.start, cg.cand, cg.cost, 1e6 * (cg.maxCost + 1.0));
+    rep.scanned = ar.scanned;
+    for (int i = 0; i < n; ++i) {
+        int j = ar.objOf[i];
+        if (j < 0) continue;
+        ambOf[i] = cg.globalOf[j];
+        for (int e = cg.start[i]; e < cg.start[i + 1]; ++e) if (cg.cand[e] == j) { distOf[i] = cg.cost[e]; break; }
+        grid.remove(ambOf[i]);
+    }
+    // Incidents left on their dummy: nearest of what remains.
+    for (int i = 0; i < n; ++i) {
+        if (ambOf[i] >= 0) continue;
+        double d;
+        int a = grid.nearest(incidents[batch[i]].x, incidents[batch[i]].y, d);
+        if (a < 0) continue;
+        ambOf[i] = a;
+        distOf[i] = d;
+        grid.remove(a);
+    }
+    for (int i = 0; i < n; ++i) {
+        if (ambOf[i] < 0) continue;
+        ++rep.assigned;
+        rep.totalDist += distOf[i];
+    }
+    auto t1 = chrono::high_resolution_clock::now();
+    rep.solveMs = chrono::duration<double, milli>(t1 - t0).count();
+}
+
+// ------------------------- Demand heatmap & pre-positioning ------------
+
+// Severity-weighted kernel density of incident demand on a G x G grid. Each incident
+// stamps a truncated Gaussian (precomputed stencil) into the grid, so an update costs
+// O(stencil) rather than a recompute. Old incidents fade with the given half-life:
+// rather than decaying every cell, new stamps are scaled up by exp(t/tau) and the
+// grid is renormalised only when that factor grows large.
+class DemandHeatmap {
+public:
+    void init(int g, double x0, double y0, double x1, double y1, double bandwidth, double halfLife) {
+        G_ = max(1, g);
+        minX_ = x0; minY_ = y0;
+        cellW_ = (x1 - x0) / G_;
+        cellH_ = (y1 - y0) / G_;
+        heat_.assign((size_t)G_ * G_, 0.0);
+        rx_ = max(0, (int)ceil(3.0 * bandwidth / cellW_));
+        ry_ = max(0, (int)ceil(3.0 * bandwidth / cellH_));
+        stencil_.assign((size_t)(2 * rx_ + 1) * (2 * ry_ + 1), 0.0);
+        for (int dy = -ry_; dy <= ry_; ++dy)
+            for (int dx = -rx_; dx <= rx_; ++dx) {
+                double mx = dx * cellW_, my = dy * cellH_;
+                stencil_[(size_t)(dy + ry_) * (2 * rx_ + 1) + (dx + rx_)] =
+                    exp(-(mx*mx + my*my) / (2.0 * bandwidth * bandwidth));
+            }
+        tau_ = halfLife > 0 ? halfLife / log(2.0) : 0.0;
+        tRef_ = 0;
+        total_ = 0;
+    }
+
+    int cells() const { return G_ * G_; }
+    double total() const { return total_; }
+
+    void add(double x, double y, double w, double t) {
+        if (tau_ > 0) {
+            double e = (t - tRef_) / tau_;
+            if (e > 30.0) {
+                double f = exp(-e);
+                for (double &h : heat_) h *= f;
+                total_ *= f;
+                tRef_ = t;
+                e = 0;
+            }
+            w *= exp(e);
+        }
+        int cx = cellX(x), cy = cellY(y);
+        for (int dy = -ry_; dy <= ry_; ++dy) {
+            int gy = cy + dy;
+            if (gy < 0 || gy >= G_) continue;
+            const double *st = &stencil_[(size_t)(dy + ry_) * (2 * rx_ + 1)];
+            double *row = &heat_[(size_t)gy * G_];
+            for (int dx = max(-rx_, -cx); dx <= min(rx_, G_ - 1 - cx); ++dx) row[cx + dx] += w * st[dx + rx_];
+        }
+        total_ += w;
+    }
+
+    // Pick up to k posting locations where demand is not yet covered. Demand around
+    // each existing post is damped by the coverage of a unit there; then the hottest
+    // remaining cell is taken (and damped) repeatedly while it still holds at least
+    // minShare of the hottest cell's raw demand.
+    void pickTargets(const vector<pair<double,double>> &posts, int k, double coverRadius, double minShare,
+                     vector<pair<double,double>> &out) const {
+        out.clear();
+        if (k <= 0 || total_ <= 0) return;
+        vector<double> residual = heat_;
+        double peak = *max_element(heat_.begin(), heat_.end());
+        int crx = max(0, (int)ceil(3.0 * coverRadius / cellW_));
+        int cry = max(0, (int)ceil(3.0 * coverRadius / cellH_));
+        vector<double> keep((size_t)(2 * crx + 1) * (2 * cry + 1));
+        for (int dy = -cry; dy <= cry; ++dy)
+            for (int dx = -crx; dx <= crx; ++dx) {
+                double mx = dx * cellW_, my = dy * cellH_;
+                keep[(size_t)(dy + cry) * (2 * crx + 1) + (dx + crx)] =
+                    1.0 - exp(-(mx*mx + my*my) / (2.0 * coverRadius * coverRadius));
+            }
+        auto damp = [&](int cx, int cy) {
+            for (int dy = max(-cry, -cy); dy <= min(cry, G_ - 1 - cy); ++dy) {
+                double *row = &residual[(size_t)(cy + dy) * G_];
+                const double *kp = &keep[(size_t)(dy + cry) * (2 * crx + 1)];
+                for (int dx = max(-crx, -cx); dx <= min(crx, G_ - 1 - cx); ++dx) row[cx + dx] *= kp[dx + crx];
+            }
+        };
+        for (auto &p : posts) damp(cellX(p.first), cellY(p.second));
+        for (int it = 0; it < k; ++it) {
+            size_t best = max_element(residual.begin(), residual.end()) - residual.begin();
+            if (residual[best] < minShare * peak) break;
+            int cx = (int)(best % G_), cy = (int)(best / G_);
+            out.push_back({minX_ + (cx + 0.5) * cellW_, minY_ + (cy + 0.5) * cellH_});
+            damp(cx, cy);
+        }
+    }
+
+private:
+    int G_ = 1, rx_ = 0, ry_ = 0;
+    double minX_ = 0, minY_ = 0, cellW_ = 1, cellH_ = 1;
+    double tau_ = 0, tRef_ = 0, total_ = 0;
+    vector<double> heat_;
+    vector<double> stencil_;
+
+    int cellX(double x) const { return min(G_ - 1, max(0, (int)floor((x - minX_) / cellW_))); }
+    int cellY(double y) const { return min(G_ - 1, max(0, (int)floor((y - minY_) / cellH_))); }
+};
+
+struct RepositionMove {
+    int ambulance;
+    double x, y;       // new post
+    double distance;
+};
+
+// Plan moves of idle ambulances (those currently in `grid`) toward uncovered demand.
+// Up to maxMoveShare of the idle units get a target from the heatmap gaps left by
+// the current idle posts; targets are then matched to nearby idle units (within
+// maxMove) by minimum total relocation distance. Moves shorter than minMove are
+// dropped. Planning cost is O(idle x coverage stencil + targets x grid cells).
+void planReposition(const DemandHeatmap &heat, const AmbulanceGrid &grid, const vector<Ambulance> &ambulances,
+                    int candK, double coverRadius, double minShare, double maxMoveShare,
+                    double maxMove, double minMove, vector<RepositionMove> &moves) {
+    moves.clear();
+    vector<pair<double,double>> posts, targets;
+    posts.reserve(grid.count);
+    for (size_t i = 0; i < ambulances.size(); ++i)
+        if (grid.contains((int)i)) posts.push_back({ambulances[i].x, ambulances[i].y});
+    int k = (int)ceil(maxMoveShare * posts.size());
+    heat.pickTargets(posts, k, coverRadius, minShare, targets);
+    if (targets.empty()) return;
+    vector<vector<pair<double,int>>> near(targets.size());
+    for (size_t t = 0; t < targets.size(); ++t) {
+        grid.kNearest(targets[t].first, targets[t].second, candK, near[t]);
+        while (!near[t].empty() && near[t].back().first > maxMove) near[t].pop_back();
+    }
+    CandidateGraph cg = buildCandidateGraph(near);
+    AssignResult ar = assignMinCost((int)targets.size(), (int)cg.globalOf.size(), cg.start, cg.cand, cg.cost,
+                                    1e6 * (cg.maxCost + 1.0));
+    for (size_t t = 0; t < targets.size(); ++t) {
+        int j = ar.objOf[t];
+        if (j < 0) continue;
+        double d = 0;
+        for (int e = cg.start[t]; e < cg.start[t + 1]; ++e) if (cg.cand[e] == j) { d = cg.cost[e]; break; }
+        if (d < minMove) continue;
+        moves.push_back({cg.globalOf[j], targets[t].first, targets[t].second, d});
+    }
+}
+
+// ------------------------- Dispatch simulation -------------------------
+
+// Parameters of the discrete-event model. Distances are in metres, times in seconds.
+struct SimConfig {
+    double speed = 10.0;          // travel speed (m/s), used for both legs
+    long onSceneBase = 600;       // on-scene time for every incident
+    long onScenePerSeverity = 120; // extra on-scene time per severity level
+    long batchWindow = 0;         // >0: dispatch queued incidents every batchWindow s as one assignment problem
+    int candK = 16;               // candidate ambulances per incident in batch mode
+    ThreadPool *pool = nullptr;   // optional, parallelises batch candidate search
+    // Pre-positioning of idle ambulances toward predicted demand (repositionInterval > 0)
+    long repositionInterval = 0;  // rebalance every N s (only while no incident is queued)
+    int heatGrid = 64;            // demand heatmap resolution (cells per side)
+    double heatBandwidth = 2000;  // kernel bandwidth (m)
+    double heatHalfLife = 7 * 86400.0; // demand memory (s)
+    double coverRadius = 5000;    // demand a posted unit is assumed to cover (m)
+    double gapShare = 0.25;       // only chase uncovered demand >= this share of the peak cell
+    double maxMoveShare = 0.1;    // at most this share of idle units moves per rebalance
+    double maxMove = 10000;       // longest relocation considered (m)
+    double minMove = 500;         // relocations shorter than this are skipped (m)
+};
+
+// One served incident.
+struct SimRecord {
+    int incident;           // index into incidents
+    int ambulance;          // index into ambulances
+    double distance;        // base -> scene
+    long arrival_time;      // incident timestamp
+    long dispatch_time;
+    long on_scene_time;
+    long available_time;    // back at base and available again
+};
+
+struct SimStats {
+    size_t served = 0;
+    size_t events = 0;
+    size_t maxPending = 0;
+    double wallSeconds = 0;
+    double utilization = 0;   // busy ambulance-seconds / (fleet * simulated span)
+    vector<double> waits;     // dispatch_time - arrival_time
+    vector<double> responses; // wait + travel time to scene
+    vector<double> distances;
+    vector<double> batchMs;   // batch mode: solve latency per non-empty batch
+    double batchDist = 0;     // batch mode: total distance of batched assignments
+    double batchGreedyDist = 0; // ... and of greedy on the same batches
+    vector<double> rebalanceMs; // pre-positioning: planning latency per rebalance
+    size_t relocations = 0;
+    double relocationDist = 0;
+};
+
+// Event-driven replay of an incident log against a fleet. Each incident goes through
+// ARRIVAL -> (queued until an ambulance is free) -> ON_SCENE -> CLEAR -> AVAILABLE.
+// Ambulances are dispatched from and return to their home position; the nearest
+// available one is found through the grid index. Incidents waiting for a unit are
+// served by severity, then age. Pending events live in a hierarchical timer wheel.
+// With cfg.batchWindow > 0, queued incidents are only dispatched at window
+// boundaries, all together, through batchAssign().
+// With cfg.repositionInterval > 0, every incident also updates a demand heatmap and
+// idle ambulances are periodically moved toward it (unavailable while driving).
+// `order` may pass a precomputed arrivalOrder(incidents) to share between runs.
+SimStats runDispatchSimulation(const vector<Incident> &incidents, vector<Ambulance> ambulances,
+                               const SimConfig &cfg, vector<SimRecord> *records,
+                               const vector<int> *order = nullptr) {
+    enum : uint32_t { EV_ARRIVAL = 0, EV_ON_SCENE = 1, EV_CLEAR = 2, EV_AVAILABLE = 3, EV_BATCH = 4,
+                      EV_RELOCATED = 5, EV_REBALANCE = 6 };
+    auto encode = [](uint32_t type, int idx) { return (type << 29) | (uint32_t)idx; };
+
+    SimStats st;
+    if (incidents.empty() || ambulances.empty()) return st;
+
+    // Arrival order by timestamp
+    vector<int> ownOrder;
+    if (!order) { ownOrder = arrivalOrder(incidents); order = &ownOrder; }
+    long t0 = incidents[order->front()].timestamp;
+
+    AmbulanceGrid grid;
+    for (auto &a : ambulances) a.available = true;
+    grid.buildFrom(ambulances, 0.0, 0.0, 100000.0, 100000.0);
+
+    auto byPriority = [&](int a, int b) { return IncidentComparator()(incidents[a], incidents[b]); };
+    priority_queue<int, vector<int>, decltype(byPriority)> pending(byPriority);
+
+    vector<int> crewOf(ambulances.size(), -1);  // incident currently handled by each ambulance
+    vector<size_t> recordOf(ambulances.size(), 0);
+    double busySeconds = 0;
+    st.waits.reserve(incidents.size());
+    st.responses.reserve(incidents.size());
+    st.distances.reserve(incidents.size());
+    if (records) records->reserve(incidents.size());
+
+    TimerWheel wheel(0);
+    size_t nextArrival = 0;
+    wheel.schedule(0, encode(EV_ARRIVAL, (*order)[0]));
+    if (cfg.batchWindow > 0) wheel.schedule((uint64_t)cfg.batchWindow, encode(EV_BATCH, 0));
+    DemandHeatmap heat;
+    vector<RepositionMove> moves;
+    if (cfg.repositionInterval > 0) {
+        heat.init(cfg.heatGrid, 0.0, 0.0, 100000.0, 100000.0, cfg.heatBandwidth, cfg.heatHalfLife);
+        wheel.schedule((uint64_t)cfg.repositionInterval, encode(EV_REBALANCE, 0));
+    }
+
+    auto travelTicks = [&](double d) { return max(1L, (long)ceil(d / cfg.speed)); };
+
+    uint64_t now = 0, lastTick = 0;
+    auto dispatch = [&](int inc, int amb, double d) {
+        const Incident &ins = incidents[inc];
+        ambulances[amb].available = false;
+        crewOf[amb] = inc;
+        long travel = travelTicks(d);
+        long arrival = ins.timestamp - t0;
+        double wait = (double)((long)now - arrival);
+        st.waits.push_back(wait);
+        st.responses.push_back(wait + travel);
+        st.distances.push_back(d);
+        busySeconds += 2.0 * travel + cfg.onSceneBase + cfg.onScenePerSeverity * ins.severity;
+        if (records) {
+            recordOf[amb] = records->size();
+            records->push_back({inc, amb, d, ins.timestamp, t0 + (long)now, t0 + (long)now + travel, -1});
+        }
+        ++st.served;
+        wheel.schedule(now + travel, encode(EV_ON_SCENE, amb));
+    };
+    vector<int> batch, batchAmb;
+    vector<double> batchDist;
+
+    auto t_start = chrono::high_resolution_clock::now();
+    uint32_t payload;
+    while (wheel.pop(now, payload)) {
+        // Process every event due at this tick, then dispatch queued incidents.
+        bool batchDue = false, rebalanceDue = false;
+        for (;;) {
+            ++st.events;
+            uint32_t type = payload >> 29;
+            int idx = (int)(payload & ((1u << 29) - 1));
+            switch (type) {
+            case EV_ARRIVAL:
+                pending.push(idx);
+                if (cfg.repositionInterval > 0)
+                    heat.add(incidents[idx].x, incidents[idx].y, incidents[idx].severity, (double)now);
+                if (++nextArrival < order->size())
+                    wheel.schedule((uint64_t)(incidents[(*order)[nextArrival]].timestamp - t0),
+                                   encode(EV_ARRIVAL, (*order)[nextArrival]));
+                break;
+            case EV_ON_SCENE: {
+                const Incident &ins = incidents[crewOf[idx]];
+                long onScene = cfg.onSceneBase + cfg.onScenePerSeverity * ins.severity;
+                wheel.schedule(now + onScene, encode(EV_CLEAR, idx));
+                break;
+            }
+            case EV_CLEAR: {
+                const Incident &ins = incidents[crewOf[idx]];
+                double dx = ins.x - ambulances[idx].x, dy = ins.y - ambulances[idx].y;
+                wheel.schedule(now + travelTicks(sqrt(dx*dx + dy*dy)), encode(EV_AVAILABLE, idx));
+                break;
+            }
+            case EV_AVAILABLE:
+                if (records) (*records)[recordOf[idx]].available_time = t0 + (long)now;
+                crewOf[idx] = -1;
+                ambulances[idx].available = true;
+                grid.insert(idx, ambulances[idx].x, ambulances[idx].y);
+                break;
+            case EV_BATCH:
+                batchDue = true;
+                break;
+            case EV_RELOCATED:
+                ambulances[idx].available = true;
+                grid.insert(idx, ambulances[idx].x, ambulances[idx].y);
+                break;
+            case EV_REBALANCE:
+                rebalanceDue = true;
+                break;
+            }
+            if (!wheel.dueNow()) break;
+            wheel.pop(now, payload);
+        }
+        st.maxPending = max(st.maxPending, pending.size());
+        if (cfg.batchWindow == 0) {
+            while (!pending.empty() && grid.count > 0) {
+                int inc = pending.top(); pending.pop();
+                double d;
+                int amb = grid.nearest(incidents[inc].x, incidents[inc].y, d);
+                grid.remove(amb);
+                dispatch(inc, amb, d);
+            }
+        } else if (batchDue) {
+            // Highest-priority incidents first, at most one per available ambulance.
+            batch.clear();
+            while (!pending.empty() && batch.size() < grid.count) { batch.push_back(pending.top()); pending.pop(); }
+            if (!batch.empty()) {
+                BatchReport rep;
+                batchAssign(grid, ambulances, incidents, batch, cfg.candK, cfg.pool, batchAmb, batchDist, rep);
+                for (size_t i = 0; i < batch.size(); ++i) {
+                    if (batchAmb[i] >= 0) dispatch(batch[i], batchAmb[i], batchDist[i]);
+                    else pending.push(batch[i]);
+                }
+                st.batchMs.push_back(rep.solveMs);
+                st.batchDist += rep.totalDist;
+                st.batchGreedyDist += rep.greedyDist;
+            }
+            if (nextArrival < order->size() || !pending.empty())
+                wheel.schedule(now + cfg.batchWindow, encode(EV_BATCH, 0));
+        }
+        if (rebalanceDue) {
+            if (pending.empty() && grid.count > 0) {
+                auto r0 = chrono::high_resolution_clock::now();
+                planReposition(heat, grid, ambulances, cfg.candK, cfg.coverRadius, cfg.gapShare, cfg.maxMoveShare,
+                               cfg.maxMove, cfg.minMove, moves);
+                for (auto &mv : moves) {
+                    grid.remove(mv.ambulance);
+                    ambulances[mv.ambulance].available = false;
+                    ambulances[mv.ambulance].x = mv.x;
+                    ambulances[mv.ambulance].y = mv.y;
+                    wheel.schedule(now + travelTicks(mv.distance), encode(EV_RELOCATED, mv.ambulance));
+                    ++st.relocations;
+                    st.relocationDist += mv.distance;
+                }
+                auto r1 = chrono::high_resolution_clock::now();
+                st.rebalanceMs.push_back(chrono::duration<double, milli>(r1 - r0).count());
+            }
+            if (nextArrival < order->size())
+                wheel.schedule(now + cfg.repositionInterval, encode(EV_REBALANCE, 0));
+        }
+        lastTick = now;
+    }
+    auto t_end = chrono::high_resolution_clock::now();
+    st.wallSeconds = chrono::duration<double>(t_end - t_start).count();
+    double span = max(1.0, (double)lastTick);
+    st.utilization = busySeconds / (span * ambulances.size());
+    return st;
+}
+
+void printSimSummary(const SimStats &st, size_t fleet) {
+    cout << fixed << setprecision(1);
+    cout << "Simulation: fleet=" << fleet << ", served=" << st.served
+         << ", events=" << st.events << ", max queued incidents=" << st.maxPending << "\n";
+    cout << "  wait (s):      p50=" << percentile(st.waits, 50) << " p90=" << percentile(st.waits, 90)
+         << " p99=" << percentile(st.waits, 99) << "\n";
+    cout << "  response (s):  p50=" << percentile(st.responses, 50) << " p90=" << percentile(st.responses, 90)
+         << " p99=" << percentile(st.responses, 99) << "\n";
+    cout << "  distance (m):  p50=" << percentile(st.distances, 50) << " p90=" << percentile(st.distances, 90) << "\n";
+    cout << setprecision(3) << "  utilization:   " << st.utilization << "\n";
+    if (!st.batchMs.empty()) {
+        cout << "  batches:       " << st.batchMs.size() << ", solve ms p50=" << percentile(st.batchMs, 50)
+             << " p99=" << percentile(st.batchMs, 99) << " max=" << *max_element(st.batchMs.begin(), st.batchMs.end()) << "\n";
+        cout << setprecision(1) << "  batch distance: " << st.batchDist << " m (greedy on same batches: "
+             << st.batchGreedyDist << " m)\n";
+    }
+    if (!st.rebalanceMs.empty()) {
+        cout << setprecision(3) << "  rebalances:    " << st.rebalanceMs.size() << ", plan ms p50=" << percentile(st.rebalanceMs, 50)
+             << " p99=" << percentile(st.rebalanceMs, 99) << " max=" << *max_element(st.rebalanceMs.begin(), st.rebalanceMs.end()) << "\n";
+        cout << setprecision(1) << "  relocations:   " << st.relocations << " (" << st.relocationDist / 1000.0 << " km)\n";
+    }
+    cout << setprecision(0) << "  wall time:     " << st.wallSeconds * 1e3 << " ms ("
+         << (st.wallSeconds > 0 ? st.events / st.wallSeconds : 0.0) << " events/s)\n";
+    cout.unsetf(ios::floatfield);
+    cout << setprecision(6);
+}
+
+// ------------------------- Scenario sweep ------------------------------
+
+struct SweepResult {
+    int fleet;
+    uint32_t seed;
+    size_t served;
+    double distP50, distP90, distP99, distMean;
+    double respP50, respP90, waitP90;
+    double utilization;
+    double wallMs;
+};
+
+// Capacity-planning sweep: every (fleet size, placement seed) pair is one independent
+// simulation over the same incident log. The log and its arrival order are built
+// once and shared read-only; scenarios run one per task on the pool.
+vector<SweepResult> runSweep(const vector<Incident> &incidents, const vector<int> &fleets, int placements,
+                             uint32_t baseSeed, SimConfig cfg, ThreadPool &pool) {
+    cfg.pool = nullptr;  // scenarios already occupy the pool
+    const vector<int> order = arrivalOrder(incidents);
+    vector<future<SweepResult>> futs;
+    for (int fleet : fleets) {
+        for (int p = 0; p < placements; ++p) {
+            uint32_t seed = baseSeed + (uint32_t)p;
+            futs.push_back(pool.submit([&incidents, &order, cfg, fleet, seed] {
+                SimStats st = runDispatchSimulation(incidents, generateFleet(fleet, seed), cfg, nullptr, &order);
+                SweepResult r;
+                r.fleet = fleet;
+                r.seed = seed;
+                r.served = st.served;
+                r.distP50 = percentile(st.distances, 50);
+                r.distP90 = percentile(st.distances, 90);
+                r.distP99 = percentile(st.distances, 99);
+                r.distMean = st.distances.empty() ? 0.0
+                    : accumulate(st.distances.begin(), st.distances.end(), 0.0) / st.distances.size();
+                r.respP50 = percentile(st.responses, 50);
+                r.respP90 = percentile(st.responses, 90);
+                r.waitP90 = percentile(st.waits, 90);
+                r.utilization = st.utilization;
+                r.wallMs = st.wallSeconds * 1e3;
+                return r;
+            }));
+        }
+    }
+    vector<SweepResult> results;
+    results.reserve(futs.size());
+    for (auto &f : futs) results.push_back(f.get());
+    return results;
+}
+
+vector<int> parseIntList(const string &s) {
+    vector<int> out;
+    stringstream ss(s);
+    string tok;
+    while (getline(ss, tok, ',')) if (!tok.empty()) out.push_back(stoi(tok));
+    return out;
 }
 
 int main(int argc, char** argv) {
     ios::sync_with_stdio(false);
     cin.tie(nullptr);
     if (argc < 2) {
-        cerr << "Usage: " << argv[0] << " incidents.csv\n";
+        cerr << "Usage: " << argv[0] << " incidents.csv [--index grid|scan] [--fleet N]\n";
+        cerr << "       " << argv[0] << " incidents.csv --simulate [--fleet N] [--speed m/s] [--onscene s]\n";
+        cerr << "       " << argv[0] << " --synthetic N [--days D] [--hotspots H] --simulate ...\n";
+        cerr << "  batch mode: --batch-window S [--candidates K] [--threads T] (with or without --simulate)\n";
+        cerr << "  pre-positioning (--simulate/--sweep): --reposition S [--heat-grid G] [--heat-bandwidth m]\n";
+        cerr << "                    [--heat-halflife s] [--cover-radius m] [--max-move m] [--gap-share f]\n";
+        cerr << "       " << argv[0] << " incidents.csv --sweep 100,200,400 [--placements P] [--seed S] [--threads T]\n";
+        cerr << "       " << argv[0] << " --bench [fleet=100000] [queries=10000]\n";
         return 1;
     }
 
-    string incidents_file = argv[1];
+    if (string(argv[1]) == "--bench") {
+        int fleet = (argc >= 3) ? stoi(argv[2]) : 100000;
+        int queries = (argc >= 4) ? stoi(argv[3]) : 10000;
+        return runIndexBenchmark(fleet, queries);
+    }
 
-    // 1) Read incidents CSV
+    string incidents_file;
+    string index_mode = "grid";
+    bool simulate = false;
+    int num_amb = 200;
+    uint32_t fleet_seed = 12345;
+    vector<int> sweep_fleets;
+    int placements = 1;
+    size_t synthetic = 0;
+    int synthetic_days = 30;
+    int hotspots = 0;
+    unsigned num_threads = max(1u, thread::hardware_concurrency());
+    SimConfig sim_cfg;
+    for (int i = 1; i < argc; ++i) {
+        string s = argv[i];
+        if (s == "--index" && i+1 < argc) index_mode = argv[++i];
+        else if (s == "--simulate") simulate = true;
+        else if (s == "--fleet" && i+1 < argc) num_amb = stoi(argv[++i]);
+        else if (s == "--speed" && i+1 < argc) sim_cfg.speed = stod(argv[++i]);
+        else if (s == "--onscene" && i+1 < argc) sim_cfg.onSceneBase = stol(argv[++i]);
+        else if (s == "--synthetic" && i+1 < argc) synthetic = stoull(argv[++i]);
+        else if (s == "--days" && i+1 < argc) synthetic_days = stoi(argv[++i]);
+        else if (s == "--hotspots" && i+1 < argc) hotspots = stoi(argv[++i]);
+        else if (s == "--batch-window" && i+1 < argc) sim_cfg.batchWindow = stol(argv[++i]);
+        else if (s == "--candidates" && i+1 < argc) sim_cfg.candK = stoi(argv[++i]);
+        else if (s == "--threads" && i+1 < argc) num_threads = (unsigned)stoi(argv[++i]);
+        else if (s == "--reposition" && i+1 < argc) sim_cfg.repositionInterval = stol(argv[++i]);
+        else if (s == "--heat-grid" && i+1 < argc) sim_cfg.heatGrid = stoi(argv[++i]);
+        else if (s == "--heat-bandwidth" && i+1 < argc) sim_cfg.heatBandwidth = stod(argv[++i]);
+        else if (s == "--heat-halflife" && i+1 < argc) sim_cfg.heatHalfLife = stod(argv[++i]);
+        else if (s == "--cover-radius" && i+1 < argc) sim_cfg.coverRadius = stod(argv[++i]);
+        else if (s == "--max-move" && i+1 < argc) sim_cfg.maxMove = stod(argv[++i]);
+        else if (s == "--gap-share" && i+1 < argc) sim_cfg.gapShare = stod(argv[++i]);
+        else if (s == "--seed" && i+1 < argc) fleet_seed = (uint32_t)stoul(argv[++i]);
+        else if (s == "--sweep" && i+1 < argc) sweep_fleets = parseIntList(argv[++i]);
+        else if (s == "--placements" && i+1 < argc) placements = max(1, stoi(argv[++i]));
+        else if (incidents_file.empty() && s.rfind("--", 0) != 0) incidents_file = s;
+    }
+    bool use_grid = (index_mode != "scan");
+
+    // 1) Read incidents CSV (or generate a synthetic log)
     vector<Incident> incidents;
-    {
-        ifstream fin(incidents_file);
-        if (!fin) {
-            cerr << "Failed to open " << incidents_file << "\n";
+    if (synthetic > 0) {
+        incidents = generateSyntheticIncidents(synthetic, synthetic_days, 777, hotspots);
+        cout << "Generated " << incidents.size() << " synthetic incidents over " << synthetic_days << " days\n";
+    } else {
+        if (incidents_file.empty()) {
+            cerr << "No incidents file given\n";
             return 1;
         }
-        string header;
-        getline(fin, header); // skip header
-        string line;
-        while (getline(fin, line)) {
-            if (line.empty()) continue;
-            stringstream ss(line);
-            string id, sev_s, x_s, y_s, ts_s;
-            // CSV: incident_id,severity,x,y,timestamp
-            getline(ss, id, ',');
-            getline(ss, sev_s, ',');
-            getline(ss, x_s, ',');
-            getline(ss, y_s, ',');
-            getline(ss, ts_s, ',');
-            Incident ins;
-            ins.id = id;
-            ins.severity = stoi(sev_s);
-            ins.x = stod(x_s);
-            ins.y = stod(y_s);
-            ins.timestamp = stol(ts_s);
-            incidents.push_back(ins);
+        if (!loadIncidentsCsv(incidents_file, incidents)) {
+            cerr << "Failed to open " << incidents_file << "\n";
+            return 1;
         }
         cout << "Loaded " << incidents.size() << " incidents from " << incidents_file << "\n";
     }
 
+    if (!sweep_fleets.empty()) {
+        ThreadPool sweep_pool(num_threads);
+        cout << "Sweeping " << sweep_fleets.size() << " fleet sizes x " << placements << " placements on "
+             << sweep_pool.size() << " threads ...\n";
+        auto t0 = chrono::high_resolution_clock::now();
+        vector<SweepResult> results = runSweep(incidents, sweep_fleets, placements, fleet_seed, sim_cfg, sweep_pool);
+        auto t1 = chrono::high_resolution_clock::now();
+        string out_csv = "sweep_summary.csv";
+        ofstream fout(out_csv);
+        fout << "fleet,seed,served,dist_mean,dist_p50,dist_p90,dist_p99,response_p50,response_p90,wait_p90,utilization,wall_ms\n";
+        cout << fixed << setprecision(1);
+        cout << setw(7) << "fleet" << setw(8) << "seed" << setw(10) << "served" << setw(10) << "d_p50"
+             << setw(10) << "d_p90" << setw(10) << "d_p99" << setw(10) << "r_p90" << setw(8) << "util" << "\n";
+        for (auto &r : results) {
+            fout << r.fleet << "," << r.seed << "," << r.served << "," << r.distMean << "," << r.distP50 << ","
+                 << r.distP90 << "," << r.distP99 << "," << r.respP50 << "," << r.respP90 << "," << r.waitP90 << ","
+                 << r.utilization << "," << r.wallMs << "\n";
+            cout << setw(7) << r.fleet << setw(8) << r.seed << setw(10) << r.served << setw(10) << r.distP50
+                 << setw(10) << r.distP90 << setw(10) << r.distP99 << setw(10) << r.respP90
+                 << setw(8) << setprecision(3) << r.utilization << setprecision(1) << "\n";
+        }
+        fout.close();
+        cout << "Sweep of " << results.size() << " scenarios took " << setprecision(3)
+             << chrono::duration<double>(t1 - t0).count() << " s; summary written to " << out_csv << "\n";
+        return 0;
+    }
+
     // 2) Create some ambulances (for simulation). In production, read from CSV / DB.
-    vector<Ambulance> ambulances;
-    {
-        // Example: 200 ambulances uniformly distributed
-        int NUM_AMB = 200;
-        ambulances.reserve(NUM_AMB);
-        std::mt19937 rng(12345);
-        std::uniform_real_distribution<double> distXY(0.0, 100000.0);
-        for (int i = 0; i < NUM_AMB; ++i) {
-            Ambulance a;
-            a.id = "AMB" + to_string(i+1);
-            a.x = distXY(rng);
-            a.y = distXY(rng);
-            a.available = true;
-            ambulances.push_back(a);
-        }
-        cout << "Generated " << ambulances.size() << " ambulances\n";
+    vector<Ambulance> ambulances = generateFleet(num_amb, fleet_seed);
+    cout << "Generated " << ambulances.size() << " ambulances\n";
+
+    unique_ptr<ThreadPool> pool;
+    if (sim_cfg.batchWindow > 0 && num_threads > 1) {
+        pool.reset(new ThreadPool(num_threads));
+        sim_cfg.pool = pool.get();
+    }
+
+    if (simulate) {
+        vector<SimRecord> records;
+        SimStats st = runDispatchSimulation(incidents, ambulances, sim_cfg, &records);
+        printSimSummary(st, ambulances.size());
+        string out_csv = "sim_assignments.csv";
+        ofstream fout(out_csv);
+        fout << "incident_id,ambulance_id,distance,arrival_time,dispatch_time,on_scene_time,available_time\n";
+        for (auto &r : records) {
+            fout << incidents[r.incident].id << "," << ambulances[r.ambulance].id << "," << r.distance << ","
+                 << r.arrival_time << "," << r.dispatch_time << "," << r.on_scene_time << "," << r.available_time << "\n";
+        }
+        fout.close();
+        cout << "Simulated assignments written to " << out_csv << "\n";
+        return 0;
+    }
+
+    // Spatial index over available ambulances (same extent as the generator above)
+    AmbulanceGrid grid;
+    if (use_grid || sim_cfg.batchWindow > 0) grid.buildFrom(ambulances, 0.0, 0.0, 100000.0, 100000.0);
+
+    if (sim_cfg.batchWindow > 0) {
+        // 3b/4b) Batched dispatch: incidents are grouped into windows of batchWindow seconds
+        // by timestamp; each window is assigned at its close as one assignment problem.
+        vector<int> order = arrivalOrder(incidents);
+        vector<Assignment> assignments;
+        assignments.reserve(incidents.size());
+        vector<int> batch, ambOf;
+        vector<double> distOf, latencies;
+        double total = 0, totalGreedy = 0;
+        size_t pos = 0;
+        int batchNo = 0;
+        while (pos < order.size()) {
+            long wstart = incidents[order[pos]].timestamp;
+            long wend = wstart + sim_cfg.batchWindow;
+            batch.clear();
+            while (pos < order.size() && incidents[order[pos]].timestamp < wend) batch.push_back(order[pos++]);
+            sort(batch.begin(), batch.end(), [&](int a, int b) { return IncidentComparator()(incidents[b], incidents[a]); });
+            BatchReport rep;
+            batchAssign(grid, ambulances, incidents, batch, sim_cfg.candK, sim_cfg.pool, ambOf, distOf, rep);
+            for (size_t i = 0; i < batch.size(); ++i) {
+                Assignment a;
+                a.incident_id = incidents[batch[i]].id;
+                a.ambulance_id = ambOf[i] >= 0 ? ambulances[ambOf[i]].id : "NONE";
+                a.distance = distOf[i];
+                a.assigned_time = wend;
+                if (ambOf[i] >= 0) ambulances[ambOf[i]].available = false; // never freed, as in greedy mode
+                assignments.push_back(a);
+            }
+            latencies.push_back(rep.solveMs);
+            total += rep.totalDist;
+            totalGreedy += rep.greedyDist;
+            if (batchNo < 20) {
+                cout << "Batch " << batchNo << " [" << wstart << "," << wend << "): incidents=" << rep.incidents
+                     << " candidates=" << rep.candidates << " assigned=" << rep.assigned
+                     << " dist=" << rep.totalDist << " (greedy " << rep.greedyDist << ")"
+                     << " scanned=" << rep.scanned << " solve=" << rep.solveMs << " ms\n";
+            }
+            ++batchNo;
+        }
+        cout << "Batches: " << batchNo << ", solve ms p50=" << percentile(latencies, 50)
+             << " p99=" << percentile(latencies, 99) << "\n";
+        cout << "Total distance: " << total << " (greedy on same batches: " << totalGreedy << ")\n";
+        string out_csv = "assignments.csv";
+        ofstream fout(out_csv);
+        fout << "incident_id,ambulance_id,distance,assigned_time\n";
+        for (auto &as : assignments)
+            fout << as.incident_id << "," << as.ambulance_id << "," << as.distance << "," << as.assigned_time << "\n";
+        fout.close();
+        cout << "Assignments written to " << out_csv << "\n";
+        return 0;
     }
 
     // 3) Build priority queue of incidents
@@ -109,17 +1397,10 @@ int main(int argc, char** argv) {
 
     while (!pq.empty()) {
         Incident ins = pq.top(); pq.pop();
-        // Find nearest available ambulance (linear scan)
-        double bestDist = numeric_limits<double>::infinity();
-        int bestIdx = -1;
-        for (size_t i = 0; i < ambulances.size(); ++i) {
-            if (!ambulances[i].available) continue;
-            double d = euclidDist(ins, ambulances[i]);
-            if (d < bestDist) {
-                bestDist = d;
-                bestIdx = (int)i;
-            }
-        }
+        // Find nearest available ambulance (grid index, or linear scan)
+        double bestDist;
+        int bestIdx = use_grid ? grid.nearest(ins.x, ins.y, bestDist)
+                               : nearestAvailableScan(ambulances, ins.x, ins.y, bestDist);
         if (bestIdx == -1) {
             // No ambulance available at the moment
             Assignment a;
@@ -132,6 +1413,7 @@ int main(int argc, char** argv) {
         }
         // Assign ambulance
         ambulances[bestIdx].available = false; // mark busy (for this demo we never free)
+        if (use_grid) grid.remove(bestIdx);
         Assignment a;
         a.incident_id = ins.id;
         a.ambulance_id = ambulances[bestIdx].id;
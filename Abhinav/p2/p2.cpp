@@ -1,27 +1,999 @@
 // tsp_dp.cpp
-// Compile: g++ -std=c++17 -O2 -o tsp_dp tsp_dp.cpp
-// Usage: ./tsp_dp /mnt/data/dumpsters.csv [K] [base_x] [base_y]
+// Compile: g++ -std=c++17 -O2 -pthread -o tsp_dp tsp_dp.cpp
+// Usage: ./tsp_dp /mnt/data/dumpsters.csv [K] [base_x] [base_y] [--threads T]
+//        exact solver: --solver auto|dp|bnb (auto: Held-Karp up to K=20, branch and bound above)
+//        ./tsp_dp dumpsters.csv --heuristic [base_x] [base_y] [--init nn|hilbert] [--neighbors N]
+//        ./tsp_dp dumpsters.csv --bench-heuristic [maxK=18] [base_x] [base_y]
+//        ./tsp_dp dumpsters.csv --trucks T | --capacity C [base_x] [base_y] [--cluster sweep|kmeans] [--dp-max K]
+//        any mode: --roads roads.csv [--matrix-cache file] uses road-network distances
+//        (an optional 4th CSV column gives each dumpster's demand; default 1, so capacity counts stops)
+//        (--trucks alone balances load over exactly T trucks; with --capacity too, T is a hard limit)
 // Example: ./tsp_dp /mnt/data/dumpsters.csv 16 5000 5000
 
 #include <bits/stdc++.h>
 using namespace std;
-struct Dump { string id; double x,y; };
+struct Dump { string id; double x,y; double demand = 1.0; }; // demand: optional 4th CSV column
 double euclid(double x1,double y1,double x2,double y2){
     double dx=x1-x2, dy=y1-y2; return sqrt(dx*dx+dy*dy);
 }
 
+struct Tour { double cost; vector<int> order; }; // order: visiting sequence of nodes 1..M-1 (base 0 implied at both ends)
+
+// Exact TSP by Held-Karp over M nodes (node 0 = base), dist is a flat M*M matrix.
+// Memory layout: only states (mask,last) with last in mask exist, so bit `last` is
+// squeezed out of the mask and the table is one contiguous array of K*2^(K-1)
+// doubles (K = M-1), indexed [last][mask without last]. The parent of each state is
+// one byte. Masks are processed layer by layer (by popcount); inside a layer every
+// state only reads the previous layer, so the layer is split across threads.
+// K=24 needs ~1.8 GB; each further dumpster more than doubles it, so callers
+// refuse anything above HELD_KARP_MAX_K.
+static const int HELD_KARP_MAX_K = 24;
+Tour held_karp(const vector<double> &dist, int M, int threads){
+    int K = M-1;
+    Tour t; t.cost = 0;
+    if(K <= 0) return t;
+    if(K == 1){ t.cost = 2*dist[1]; t.order = {1}; return t; }
+    const double INF = 1e18;
+    const uint64_t FULL = 1ULL<<K, HALF = 1ULL<<(K-1);
+    vector<double> dp((size_t)K*HALF, INF);
+    vector<uint8_t> parent((size_t)K*HALF, 0);
+    // index of state (mask, b) where bit b is set in mask
+    auto idx = [HALF](uint64_t mask, int b)->size_t{
+        uint64_t low = mask & ((1ULL<<b)-1);
+        uint64_t r = ((mask>>(b+1))<<b) | low;
+        return (size_t)b*HALF + r;
+    };
+    for(int b=0;b<K;b++){ dp[idx(1ULL<<b,b)] = dist[b+1]; parent[idx(1ULL<<b,b)] = 0; }
+
+    threads = max(1, threads);
+    for(int layer=2; layer<=K; ++layer){
+        auto work = [&](uint64_t lo, uint64_t hi){
+            for(uint64_t mask=lo; mask<hi; ++mask){
+                if(__builtin_popcountll(mask) != layer) continue;
+                for(uint64_t bs=mask; bs; bs&=bs-1){
+                    int b = __builtin_ctzll(bs);
+                    uint64_t prev = mask ^ (1ULL<<b);
+                    const double *col = &dist[(size_t)(b+1)];
+                    double best = INF; int arg = 0;
+                    for(uint64_t cs=prev; cs; cs&=cs-1){
+                        int c = __builtin_ctzll(cs);
+                        double cand = dp[idx(prev,c)] + col[(size_t)(c+1)*M];
+                        if(cand < best){ best = cand; arg = c+1; }
+                    }
+                    size_t k = idx(mask,b);
+                    dp[k] = best; parent[k] = (uint8_t)arg;
+                }
+            }
+        };
+        if(threads == 1 || K < 12){ work(0, FULL); continue; }
+        vector<thread> pool;
+        for(int ti=0; ti<threads; ++ti){
+            uint64_t lo = FULL*ti/threads, hi = FULL*(ti+1)/threads;
+            pool.emplace_back(work, lo, hi);
+        }
+        for(auto &th : pool) th.join();
+    }
+
+    // Close tour: full mask
+    uint64_t fullmask = FULL-1;
+    double best = INF; int lastBest = -1;
+    for(int b=0;b<K;b++){
+        double cand = dp[idx(fullmask,b)] + dist[(size_t)(b+1)*M];
+        if(cand < best){ best = cand; lastBest = b+1; }
+    }
+    t.cost = best;
+    // Reconstruct path
+    uint64_t curMask = fullmask;
+    int curLast = lastBest;
+    while(curLast != 0){
+        t.order.push_back(curLast);
+        int p = parent[idx(curMask, curLast-1)];
+        curMask ^= 1ULL<<(curLast-1);
+        curLast = p;
+    }
+    reverse(t.order.begin(), t.order.end());
+    return t;
+}
+
+// ---------- Heuristic tour for large instances ----------
+// Uniform grid over the points, used for k-nearest-neighbour candidate lists and
+// for the nearest-neighbour construction (points are removed as they are visited).
+struct PointGrid {
+    double minx=0, miny=0, cell=1; int gw=1, gh=1;
+    vector<vector<int>> cells;
+    vector<int> slot; // position of each point inside its cell
+    const vector<Dump> *pts = nullptr;
+    void build(const vector<Dump> &p){
+        pts = &p; int n = (int)p.size();
+        double maxx=-1e300, maxy=-1e300; minx=1e300; miny=1e300;
+        for(auto &d : p){ minx=min(minx,d.x); miny=min(miny,d.y); maxx=max(maxx,d.x); maxy=max(maxy,d.y); }
+        double w = maxx-minx, h = maxy-miny;
+        cell = sqrt(w*h*2.0/max(n,1));
+        cell = max({cell, w/max(n,1), h/max(n,1), 1e-9});
+        gw = (int)(w/cell)+1; gh = (int)(h/cell)+1;
+        cells.assign((size_t)gw*gh, {});
+        slot.assign(n, -1);
+        for(int i=0;i<n;i++) insert(i);
+    }
+    int cellAt(double x, double y) const {
+        int cx = max(0, min(gw-1, (int)((x-minx)/cell)));
+        int cy = max(0, min(gh-1, (int)((y-miny)/cell)));
+        return cy*gw+cx;
+    }
+    int cellOf(int i) const { return cellAt((*pts)[i].x, (*pts)[i].y); }
+    void insert(int i){ auto &c = cells[cellOf(i)]; slot[i] = (int)c.size(); c.push_back(i); }
+    void remove(int i){
+        auto &c = cells[cellOf(i)];
+        int last = c.back(); c[slot[i]] = last; slot[last] = slot[i]; c.pop_back(); slot[i] = -1;
+    }
+    // visit every cell at Chebyshev ring distance r around (cx,cy)
+    template<class F> void ring(int cx, int cy, int r, F f) const {
+        for(int y=cy-r; y<=cy+r; y++){
+            if(y<0 || y>=gh) continue;
+            bool edge = (y==cy-r || y==cy+r);
+            for(int x=cx-r; x<=cx+r; x += (edge || r==0) ? 1 : 2*r){
+                if(x>=0 && x<gw) for(int j : cells[(size_t)y*gw+x]) f(j);
+            }
+        }
+    }
+    // up to k nearest points to point i currently in the grid (i itself excluded), ascending
+    vector<int> nearest(int i, int k) const { return nearestTo((*pts)[i].x, (*pts)[i].y, k, i); }
+    vector<int> nearestTo(double qx, double qy, int k, int exclude = -1) const {
+        int c = cellAt(qx, qy), cx = c%gw, cy = c/gw, rmax = max(gw,gh);
+        priority_queue<pair<double,int>> heap; // max-heap of the k best
+        for(int r=0; r<=rmax; r++){
+            ring(cx, cy, r, [&](int j){
+                if(j==exclude) return;
+                double d = euclid(qx,qy,(*pts)[j].x,(*pts)[j].y);
+                if((int)heap.size() < k) heap.push({d,j});
+                else if(d < heap.top().first){ heap.pop(); heap.push({d,j}); }
+            });
+            // anything in ring r+1 or beyond is at least r*cell away
+            if((int)heap.size() == k && heap.top().first <= r*cell) break;
+        }
+        vector<int> out(heap.size());
+        for(int j=(int)out.size()-1; j>=0; j--){ out[j] = heap.top().second; heap.pop(); }
+        return out;
+    }
+};
+
+// Hilbert curve index of (x,y) on a 2^16 x 2^16 grid
+uint64_t hilbert_index(uint32_t x, uint32_t y){
+    uint64_t d = 0;
+    for(uint32_t s = 1u<<15; s > 0; s >>= 1){
+        uint32_t rx = (x & s) ? 1 : 0, ry = (y & s) ? 1 : 0;
+        d += (uint64_t)s*s*((3*rx)^ry);
+        if(ry == 0){
+            if(rx == 1){ x = s-1-x; y = s-1-y; }
+            swap(x,y);
+        }
+    }
+    return d;
+}
+
+// Array tour with node -> position index; 2-opt moves reverse the shorter side.
+struct ArrayTour {
+    vector<int> t, pos; int n = 0;
+    void init(const vector<int> &order){
+        t = order; n = (int)t.size(); pos.assign(n, 0);
+        for(int i=0;i<n;i++) pos[t[i]] = i;
+    }
+    int next(int a) const { int i = pos[a]+1; return t[i==n ? 0 : i]; }
+    int prev(int a) const { int i = pos[a]; return t[i==0 ? n-1 : i-1]; }
+    // reverse the forward path a..b (inclusive); the complement is reversed when shorter
+    void reversePath(int a, int b){
+        int i = pos[a], j = pos[b];
+        int len = j-i; if(len < 0) len += n; len += 1;
+        if(2*len > n){ i = pos[next(b)]; j = pos[prev(a)]; len = n-len; }
+        for(int s=0; s<len/2; s++){
+            int u = t[i], v = t[j];
+            t[i] = v; pos[v] = i; t[j] = u; pos[u] = j;
+            if(++i == n) i = 0;
+            if(--j < 0) j = n-1;
+        }
+    }
+    // drop edges (a,b),(c,d) where b follows a and d follows c in the same direction; add (a,c),(b,d).
+    // d is implied by a, b and c, so it is not passed.
+    void move2opt(int a, int b, int c){
+        if(next(a) == b) reversePath(b, c); else reversePath(c, b);
+    }
+};
+
+struct LocalSearchStats { long long twoOpt = 0, orOpt = 0; };
+
+// 2-opt + Or-opt (segments of 1..3 nodes, both orientations) restricted to the
+// candidate lists nbr (sorted by distance), driven by a queue of nodes whose
+// don't-look bit is off. D(i,j) is the distance between nodes i and j.
+template<class DistFn>
+void improve_tour(ArrayTour &T, const vector<vector<int>> &nbr, DistFn D, LocalSearchStats &st){
+    const double EPS = 1e-9;
+    int n = T.n;
+    if(n < 5) return;
+    deque<int> q; vector<char> active(n, 1);
+    for(int i=0;i<n;i++) q.push_back(T.t[i]);
+    auto wake = [&](int v){ if(!active[v]){ active[v] = 1; q.push_back(v); } };
+
+    auto try2opt = [&](int a)->bool{
+        for(int dir=0; dir<2; dir++){
+            int b = dir==0 ? T.next(a) : T.prev(a);
+            double dab = D(a,b);
+            for(int c : nbr[a]){
+                double dac = D(a,c);
+                if(dac >= dab - EPS) break; // new edge (a,c) must be shorter than (a,b)
+                int d = dir==0 ? T.next(c) : T.prev(c);
+                if(c==b || d==a) continue;
+                double delta = dac + D(b,d) - dab - D(c,d);
+                if(delta < -EPS){
+                    T.move2opt(a,b,c);
+                    wake(a); wake(b); wake(c); wake(d);
+                    return true;
+                }
+            }
+        }
+        return false;
+    };
+
+    auto tryOrOpt = [&](int a)->bool{
+        for(int L=1; L<=3 && L+3<=n; L++){
+            for(int side=0; side < (L==1 ? 1 : 2); side++){
+                // side 0: segment starts at a, side 1: segment ends at a
+                int s1 = a, s2 = a;
+                for(int k=1;k<L;k++){ if(side==0) s2 = T.next(s2); else s1 = T.prev(s1); }
+                int seg[3] = {s1, -1, -1};
+                for(int k=1;k<L;k++) seg[k] = T.next(seg[k-1]);
+                auto inSeg = [&](int v){ return v==seg[0] || v==seg[1] || v==seg[2]; };
+                int p = T.prev(s1), nx = T.next(s2);
+                double gain = D(p,s1) + D(s2,nx) - D(p,nx);
+                if(gain <= EPS) continue;
+                for(int e=0; e<2; e++){
+                    int end = e==0 ? s1 : s2, other = e==0 ? s2 : s1;
+                    for(int c : nbr[end]){
+                        double dce = D(c,end);
+                        if(dce >= gain - EPS) break;
+                        if(inSeg(c)) continue;
+                        for(int dd=0; dd<2; dd++){
+                            int d = dd==0 ? T.next(c) : T.prev(c);
+                            if(inSeg(d)) continue;
+                            double delta = dce + D(other,d) - D(c,d) - gain;
+                            if(delta >= -EPS) continue;
+                            // edge (x,y) with y = next(x); insert as x s1..s2 y or x s2..s1 y
+                            int x = dd==0 ? c : d, y = dd==0 ? d : c;
+                            bool keepDir = (dd==0) == (end==s1);
+                            T.move2opt(p, s1, x);
+                            T.move2opt(p, x, nx);
+                            if(keepDir) T.move2opt(x, s2, s1);
+                            wake(p); wake(nx); wake(x); wake(y);
+                            for(int k=0;k<L;k++) wake(seg[k]);
+                            return true;
+                        }
+                    }
+                }
+            }
+        }
+        return false;
+    };
+
+    while(!q.empty()){
+        int a = q.front(); q.pop_front(); active[a] = 0;
+        bool moved = false;
+        if(try2opt(a)){ st.twoOpt++; moved = true; }
+        else if(tryOrOpt(a)){ st.orOpt++; moved = true; }
+        if(moved) wake(a);
+    }
+}
+
+// Route every node (node 0 = base): nearest-neighbour or Hilbert start tour, then
+// 2-opt/Or-opt with `neighbors` candidates per node. With a distance matrix (flat,
+// nodes.size()^2) the search runs on its symmetric part and the tour is emitted in
+// whichever direction is cheaper; candidates stay spatial.
+Tour heuristic_tour(const vector<Dump> &nodes, int neighbors, bool hilbertStart, LocalSearchStats &st,
+                    const vector<double> *dist = nullptr){
+    int n = (int)nodes.size();
+    Tour res; res.cost = 0;
+    if(n <= 1) return res;
+    PointGrid grid; grid.build(nodes);
+    vector<vector<int>> nbr(n);
+    for(int i=0;i<n;i++) nbr[i] = grid.nearest(i, min(neighbors, n-1));
+
+    vector<int> order; order.reserve(n);
+    if(hilbertStart){
+        double w = max(grid.gw*grid.cell, 1e-9), h = max(grid.gh*grid.cell, 1e-9), span = max(w,h);
+        vector<pair<uint64_t,int>> key(n);
+        for(int i=0;i<n;i++){
+            uint32_t hx = (uint32_t)min(65535.0, (nodes[i].x-grid.minx)/span*65535.0);
+            uint32_t hy = (uint32_t)min(65535.0, (nodes[i].y-grid.miny)/span*65535.0);
+            key[i] = {hilbert_index(hx,hy), i};
+        }
+        sort(key.begin(), key.end());
+        for(auto &kv : key) order.push_back(kv.second);
+    } else {
+        int cur = 0; grid.remove(0); order.push_back(0);
+        for(int step=1; step<n; step++){
+            const Dump &q = nodes[cur];
+            int c = grid.cellOf(cur), cx = c%grid.gw, cy = c/grid.gw, rmax = max(grid.gw,grid.gh);
+            double best = 1e300; int arg = -1;
+            for(int r=0; r<=rmax; r++){
+                grid.ring(cx, cy, r, [&](int j){
+                    double d = euclid(q.x,q.y,nodes[j].x,nodes[j].y);
+                    if(d < best){ best = d; arg = j; }
+                });
+                if(arg >= 0 && best <= r*grid.cell) break;
+            }
+            grid.remove(arg); order.push_back(arg); cur = arg;
+        }
+    }
+
+    ArrayTour T; T.init(order);
+    auto D = [&](int i, int j){
+        if(dist) return (*dist)[(size_t)i*n+j];
+        return euclid(nodes[i].x,nodes[i].y,nodes[j].x,nodes[j].y);
+    };
+    if(dist) improve_tour(T, nbr, [&](int i, int j){ return 0.5*(D(i,j)+D(j,i)); }, st);
+    else improve_tour(T, nbr, D, st);
+
+    int at = T.next(0);
+    while(at != 0){ res.order.push_back(at); at = T.next(at); }
+    double fwd = 0, bwd = 0;
+    int prev = 0;
+    for(int v : res.order){ fwd += D(prev,v); bwd += D(v,prev); prev = v; }
+    fwd += D(prev,0); bwd += D(0,prev);
+    res.cost = fwd;
+    if(bwd < fwd){ reverse(res.order.begin(), res.order.end()); res.cost = bwd; }
+    return res;
+}
+
+// Nodes for a tour: BASE followed by the given dumpsters
+vector<Dump> with_base(const vector<Dump> &all, const vector<int> &pick, double base_x, double base_y){
+    vector<Dump> nodes; nodes.reserve(pick.size()+1);
+    Dump base; base.id = "BASE"; base.x = base_x; base.y = base_y;
+    nodes.push_back(base);
+    for(int i : pick) nodes.push_back(all[i]);
+    return nodes;
+}
+
+// Heuristic vs exact DP on random subsets of K dumpsters
+void run_heuristic_benchmark(const vector<Dump> &all, double base_x, double base_y, int maxK, int neighbors, bool hilbertStart, int threads){
+    int trials = 5;
+    mt19937 rng(12345);
+    cout<<"K,trials,avg_exact,avg_heuristic,avg_gap_pct,max_gap_pct,exact_ms,heuristic_ms\n";
+    for(int K=8; K<=maxK && K<=(int)all.size(); K+=2){
+        double sumE=0, sumH=0, sumGap=0, maxGap=0, msE=0, msH=0;
+        for(int tr=0; tr<trials; tr++){
+            vector<int> idx(all.size()); iota(idx.begin(), idx.end(), 0);
+            shuffle(idx.begin(), idx.end(), rng);
+            idx.resize(K);
+            vector<Dump> nodes = with_base(all, idx, base_x, base_y);
+            int M = K+1;
+            vector<double> dist((size_t)M*M);
+            for(int i=0;i<M;i++) for(int j=0;j<M;j++) dist[(size_t)i*M+j] = euclid(nodes[i].x,nodes[i].y,nodes[j].x,nodes[j].y);
+            auto t0 = chrono::high_resolution_clock::now();
+            Tour e = held_karp(dist, M, threads);
+            auto t1 = chrono::high_resolution_clock::now();
+            LocalSearchStats st;
+            Tour h = heuristic_tour(nodes, neighbors, hilbertStart, st);
+            auto t2 = chrono::high_resolution_clock::now();
+            double gap = (h.cost/e.cost - 1.0)*100.0;
+            sumE += e.cost; sumH += h.cost; sumGap += gap; maxGap = max(maxGap, gap);
+            msE += chrono::duration<double,milli>(t1-t0).count();
+            msH += chrono::duration<double,milli>(t2-t1).count();
+        }
+        cout<<K<<","<<trials<<","<<fixed<<setprecision(3)<<sumE/trials<<","<<sumH/trials<<","
+            <<sumGap/trials<<","<<maxGap<<","<<msE/trials<<","<<msH/trials<<"\n";
+    }
+    cout.unsetf(ios::floatfield);
+}
+
+void write_route_csv(const string &path, const vector<Dump> &nodes, const vector<int> &order){
+    ofstream fout(path);
+    fout<<"sequence,site_id,x,y\n";
+    fout<<0<<","<<nodes[0].id<<","<<nodes[0].x<<","<<nodes[0].y<<"\n";
+    int seq = 1;
+    for(int idx : order){
+        fout<<seq++<<","<<nodes[idx].id<<","<<nodes[idx].x<<","<<nodes[idx].y<<"\n";
+    }
+    fout<<seq<<","<<nodes[0].id<<","<<nodes[0].x<<","<<nodes[0].y<<"\n";
+}
+
+// ---------- Road-network distances ----------
+// roads.csv (header line skipped), one typed row per line:
+//   node,id,x,y        road node with coordinates
+//   road,u,v[,w]       two-way road segment
+//   oneway,u,v[,w]     one-way segment u -> v
+// A missing w is the straight-line length between the two road nodes.
+struct RoadGraph {
+    vector<Dump> pts;              // road nodes (id, x, y), dense index
+    vector<int> off, to;           // CSR adjacency
+    vector<double> w;
+    uint64_t fingerprint = 0;      // FNV-1a of the file contents
+};
+
+uint64_t fnv1a(const void *data, size_t len, uint64_t h = 1469598103934665603ULL){
+    const unsigned char *p = (const unsigned char*)data;
+    for(size_t i=0;i<len;i++){ h ^= p[i]; h *= 1099511628211ULL; }
+    return h;
+}
+
+bool load_road_graph(const string &path, RoadGraph &g, string &err){
+    ifstream fin(path, ios::binary);
+    if(!fin){ err = "Cannot open " + path; return false; }
+    string text((istreambuf_iterator<char>(fin)), istreambuf_iterator<char>());
+    g.fingerprint = fnv1a(text.data(), text.size());
+    unordered_map<string,int> idOf;
+    struct Arc { string u, v, w; bool oneway; };
+    vector<Arc> arcs;
+    stringstream in(text);
+    string line; getline(in, line);
+    while(getline(in, line)){
+        if(!line.empty() && line.back()=='\r') line.pop_back();
+        if(line.empty()) continue;
+        stringstream ss(line);
+        string type, a, b, c;
+        getline(ss,type,','); getline(ss,a,','); getline(ss,b,','); getline(ss,c,',');
+        if(type=="node"){
+            Dump d; d.id = a; d.x = stod(b); d.y = stod(c);
+            idOf[a] = (int)g.pts.size(); g.pts.push_back(d);
+        } else if(type=="road" || type=="oneway"){
+            arcs.push_back({a, b, c, type=="oneway"});
+        }
+    }
+    if(g.pts.empty()){ err = "No road nodes in " + path; return false; }
+    int V = (int)g.pts.size();
+    vector<array<double,3>> e; // u, v, w
+    for(auto &a : arcs){
+        auto iu = idOf.find(a.u), iv = idOf.find(a.v);
+        if(iu==idOf.end() || iv==idOf.end()){ err = "Road references unknown node " + (iu==idOf.end() ? a.u : a.v); return false; }
+        int u = iu->second, v = iv->second;
+        double w = a.w.empty() ? euclid(g.pts[u].x,g.pts[u].y,g.pts[v].x,g.pts[v].y) : stod(a.w);
+        e.push_back({(double)u,(double)v,w});
+        if(!a.oneway) e.push_back({(double)v,(double)u,w});
+    }
+    g.off.assign(V+1, 0);
+    for(auto &x : e) g.off[(int)x[0]+1]++;
+    for(int i=0;i<V;i++) g.off[i+1] += g.off[i];
+    g.to.resize(e.size()); g.w.resize(e.size());
+    vector<int> fill(g.off.begin(), g.off.end()-1);
+    for(auto &x : e){ int k = fill[(int)x[0]]++; g.to[k] = (int)x[1]; g.w[k] = x[2]; }
+    return true;
+}
+
+// Many-to-many shortest paths between the given points. Each point snaps to its
+// nearest road node (the straight-line snap leg is added at both ends); one
+// Dijkstra per distinct snapped node settles until every target node is reached,
+// and the sources are shared out over `threads` workers. Unreachable pairs are
+// left at +inf.
+vector<double> road_distance_matrix(const RoadGraph &g, const vector<Dump> &nodes, int threads){
+    int M = (int)nodes.size(), V = (int)g.pts.size();
+    PointGrid grid; grid.build(g.pts);
+    vector<int> snap(M); vector<double> snapLen(M);
+    for(int i=0;i<M;i++){
+        snap[i] = grid.nearestTo(nodes[i].x, nodes[i].y, 1)[0];
+        snapLen[i] = euclid(nodes[i].x, nodes[i].y, g.pts[snap[i]].x, g.pts[snap[i]].y);
+    }
+    vector<int> targets(snap.begin(), snap.end());
+    sort(targets.begin(), targets.end());
+    targets.erase(unique(targets.begin(), targets.end()), targets.end());
+    int S = (int)targets.size();
+    vector<int> slotOf(V, -1);
+    for(int k=0;k<S;k++) slotOf[targets[k]] = k;
+    vector<double> between((size_t)S*S, numeric_limits<double>::infinity()); // road-node to road-node
+
+    atomic<int> nextSource(0);
+    auto worker = [&](){
+        const double INF = numeric_limits<double>::infinity();
+        vector<double> d(V, INF);
+        vector<int> touched;
+        priority_queue<pair<double,int>, vector<pair<double,int>>, greater<>> pq;
+        for(int k; (k = nextSource.fetch_add(1)) < S; ){
+            int src = targets[k], left = S;
+            d[src] = 0; touched.push_back(src); pq.push({0.0, src});
+            while(!pq.empty() && left > 0){
+                auto [du, u] = pq.top(); pq.pop();
+                if(du > d[u]) continue;
+                if(slotOf[u] >= 0){ between[(size_t)k*S+slotOf[u]] = du; left--; }
+                for(int e=g.off[u]; e<g.off[u+1]; e++){
+                    int v = g.to[e]; double nd = du + g.w[e];
+                    if(nd < d[v]){
+                        if(d[v]==INF) touched.push_back(v);
+                        d[v] = nd; pq.push({nd, v});
+                    }
+                }
+            }
+            pq = {};
+            for(int v : touched) d[v] = INF;
+            touched.clear();
+        }
+    };
+    vector<thread> pool;
+    for(int i=0;i<max(1, min(threads, S));i++) pool.emplace_back(worker);
+    for(auto &th : pool) th.join();
+
+    vector<double> dist((size_t)M*M, 0.0);
+    for(int i=0;i<M;i++) for(int j=0;j<M;j++) if(i!=j)
+        dist[(size_t)i*M+j] = snapLen[i] + between[(size_t)slotOf[snap[i]]*S+slotOf[snap[j]]] + snapLen[j];
+    return dist;
+}
+
+// Binary matrix cache: "TSPM", version, key, M, then M*M doubles. The key hashes
+// the road file and the node list, so any change to either forces a rebuild.
+uint64_t matrix_key(const RoadGraph &g, const vector<Dump> &nodes){
+    uint64_t h = fnv1a(&g.fingerprint, sizeof(g.fingerprint));
+    for(auto &d : nodes){
+        h = fnv1a(d.id.data(), d.id.size(), h);
+        h = fnv1a(&d.x, sizeof(d.x), h);
+        h = fnv1a(&d.y, sizeof(d.y), h);
+    }
+    return h;
+}
+
+bool load_matrix_cache(const string &path, uint64_t key, int M, vector<double> &dist){
+    ifstream fin(path, ios::binary);
+    if(!fin) return false;
+    char magic[4]; uint32_t version = 0, m = 0; uint64_t k = 0;
+    fin.read(magic, 4); fin.read((char*)&version, 4); fin.read((char*)&k, 8); fin.read((char*)&m, 4);
+    if(!fin || memcmp(magic, "TSPM", 4) != 0 || version != 1 || k != key || (int)m != M) return false;
+    dist.resize((size_t)M*M);
+    fin.read((char*)dist.data(), (streamsize)(dist.size()*sizeof(double)));
+    return (bool)fin;
+}
+
+void save_matrix_cache(const string &path, uint64_t key, int M, const vector<double> &dist){
+    string tmp = path + ".tmp";
+    {
+        ofstream fout(tmp, ios::binary);
+        uint32_t version = 1, m = (uint32_t)M;
+        fout.write("TSPM", 4); fout.write((char*)&version, 4); fout.write((char*)&key, 8); fout.write((char*)&m, 4);
+        fout.write((const char*)dist.data(), (streamsize)(dist.size()*sizeof(double)));
+        if(!fout){ cerr<<"Warning: could not write matrix cache "<<path<<"\n"; return; }
+    }
+    rename(tmp.c_str(), path.c_str());
+}
+
+// Distance matrix for nodes: road distances (through the cache) when roads is set,
+// straight-line otherwise. Returns false if some pair is unreachable by road.
+bool distance_matrix(const vector<Dump> &nodes, const RoadGraph *roads, const string &cachePath, int threads, vector<double> &dist){
+    int M = (int)nodes.size();
+    if(!roads){
+        dist.assign((size_t)M*M, 0.0);
+        for(int i=0;i<M;i++) for(int j=0;j<M;j++)
+            dist[(size_t)i*M+j] = euclid(nodes[i].x, nodes[i].y, nodes[j].x, nodes[j].y);
+        return true;
+    }
+    uint64_t key = matrix_key(*roads, nodes);
+    if(load_matrix_cache(cachePath, key, M, dist)){
+        cout<<"Road distance matrix "<<M<<"x"<<M<<" loaded from "<<cachePath<<"\n";
+    } else {
+        auto t0 = chrono::high_resolution_clock::now();
+        dist = road_distance_matrix(*roads, nodes, threads);
+        auto t1 = chrono::high_resolution_clock::now();
+        cout<<"Road distance matrix "<<M<<"x"<<M<<" computed in "<<chrono::duration<double>(t1-t0).count()
+            <<" s, cached to "<<cachePath<<"\n";
+        save_matrix_cache(cachePath, key, M, dist);
+    }
+    for(double d : dist) if(!isfinite(d)){ cerr<<"Road graph does not connect all dumpsters\n"; return false; }
+    return true;
+}
+
+// ---------- Branch and bound (symmetric instances) ----------
+// Volgenant-Jonker style: the bound at every search node is the Held-Karp
+// Lagrangian 1-tree bound (node penalties pi improved by subgradient ascent, warm
+// started from the parent's pi). Branching picks a node of degree > 2 in the best
+// 1-tree and fixes two of its tree edges (out / in+out / in+in). Threads run
+// depth-first on private stacks, hand their oldest open node to a shared pool
+// whenever it runs low, and prune against a shared incumbent.
+enum : int8_t { EDGE_FREE = 0, EDGE_IN = 1, EDGE_OUT = 2 };
+
+struct BBNode { vector<int8_t> fix; vector<double> pi; double bound; };
+struct OneTree { vector<int> deg; vector<pair<int,int>> edges; double L = 0; };
+struct BBStats { long long nodes = 0; double rootBound = 0; };
+
+// Minimum 1-tree (MST on 1..n-1 plus two cheapest edges at node 0) under the
+// penalties and fixings of nd. Returns false if the fixings are infeasible.
+bool min_one_tree(const vector<double> &c, int n, const BBNode &nd, OneTree &t){
+    const double INF = numeric_limits<double>::infinity(), BIG = 1e9;
+    auto wt = [&](int i, int j){
+        int8_t f = nd.fix[(size_t)i*n+j];
+        if(f == EDGE_OUT) return INF;
+        double v = c[(size_t)i*n+j] + nd.pi[i] + nd.pi[j];
+        return f == EDGE_IN ? v - BIG : v;
+    };
+    t.deg.assign(n, 0); t.edges.clear();
+    double sum = 0;
+    auto take = [&](int a, int b){
+        t.edges.push_back({a,b}); t.deg[a]++; t.deg[b]++;
+        sum += c[(size_t)a*n+b] + nd.pi[a] + nd.pi[b];
+    };
+    int forced = 0, forcedTaken = 0;
+    for(int i=1;i<n;i++) for(int j=i+1;j<n;j++) if(nd.fix[(size_t)i*n+j] == EDGE_IN) forced++;
+    vector<double> key(n, INF); vector<int> from(n, -1); vector<char> in(n, 0);
+    key[1] = 0;
+    for(int it=1; it<n; it++){
+        int u = -1; double best = INF;
+        for(int v=1; v<n; v++) if(!in[v] && key[v] < best){ best = key[v]; u = v; }
+        if(u < 0) return false; // excluded edges disconnect the rest
+        in[u] = 1;
+        if(from[u] >= 0){
+            take(from[u], u);
+            if(nd.fix[(size_t)from[u]*n+u] == EDGE_IN) forcedTaken++;
+        }
+        for(int v=1; v<n; v++) if(!in[v]){
+            double x = wt(u,v);
+            if(x < key[v]){ key[v] = x; from[v] = u; }
+        }
+    }
+    if(forcedTaken != forced) return false; // forced edges close a cycle
+    int a = -1, b = -1; double wa = INF, wb = INF;
+    for(int v=1; v<n; v++){
+        double x = wt(0,v);
+        if(x < wa){ b = a; wb = wa; a = v; wa = x; }
+        else if(x < wb){ b = v; wb = x; }
+    }
+    if(b < 0 || wb == INF) return false;
+    if(nd.fix[b] != EDGE_IN) for(int v=1; v<n; v++) if(v!=a && v!=b && nd.fix[v]==EDGE_IN) return false; // three forced at 0
+    take(0,a); take(0,b);
+    double piSum = 0;
+    for(int i=0;i<n;i++) piSum += nd.pi[i];
+    t.L = sum - 2*piSum;
+    return true;
+}
+
+// Fix edge (a,b); an included edge that gives an endpoint two included edges
+// excludes that endpoint's other free edges. False if a node would exceed degree 2.
+bool fix_edge(BBNode &nd, int n, int a, int b, int8_t val){
+    nd.fix[(size_t)a*n+b] = nd.fix[(size_t)b*n+a] = val;
+    if(val != EDGE_IN) return true;
+    for(int x : {a,b}){
+        int cnt = 0;
+        for(int v=0; v<n; v++) if(nd.fix[(size_t)x*n+v] == EDGE_IN) cnt++;
+        if(cnt > 2) return false;
+        if(cnt == 2) for(int v=0; v<n; v++) if(v!=x && nd.fix[(size_t)x*n+v] == EDGE_FREE)
+            nd.fix[(size_t)x*n+v] = nd.fix[(size_t)v*n+x] = EDGE_OUT;
+    }
+    return true;
+}
+
+// Subgradient ascent on nd.pi; leaves the best pi in nd.pi and its 1-tree in best.
+// Stops early once the bound reaches ub or the 1-tree is a tour.
+bool ascend(const vector<double> &c, int n, BBNode &nd, double ub, int iters, double lambda, OneTree &best){
+    OneTree t;
+    vector<double> bestPi = nd.pi;
+    best.L = -numeric_limits<double>::infinity();
+    int period = max(5, iters/10), sinceImprove = 0;
+    bool any = false;
+    for(int it=0; it<iters; it++){
+        if(!min_one_tree(c, n, nd, t)) return any;
+        any = true;
+        if(t.L > best.L + 1e-9){ best = t; bestPi = nd.pi; sinceImprove = 0; }
+        else if(++sinceImprove >= period){ lambda *= 0.5; sinceImprove = 0; }
+        if(best.L >= ub) break;
+        double norm = 0;
+        for(int i=0;i<n;i++) norm += (double)(t.deg[i]-2)*(t.deg[i]-2);
+        if(norm == 0 || lambda < 1e-6) break; // 1-tree is a tour
+        double step = lambda*(ub - t.L)/norm;
+        for(int i=0;i<n;i++) nd.pi[i] += step*(t.deg[i]-2);
+    }
+    nd.pi = bestPi;
+    return true;
+}
+
+// Exact tour for a symmetric flat M*M matrix, starting from the incumbent `init`.
+Tour branch_and_bound(const vector<double> &c, int M, int threads, const Tour &init, BBStats &st){
+    int n = M;
+    Tour res = init;
+    if(n <= 3) return res;
+    mutex mu; condition_variable cv;
+    vector<BBNode> pool;
+    int idle = 0; bool done = false;
+    atomic<double> ub(init.cost);
+    atomic<long long> explored(0);
+    threads = max(1, threads);
+
+    BBNode root; root.fix.assign((size_t)n*n, EDGE_FREE); root.pi.assign(n, 0.0);
+    root.bound = -numeric_limits<double>::infinity();
+    for(int i=0;i<n;i++) root.fix[(size_t)i*n+i] = EDGE_OUT;
+    pool.push_back(move(root));
+    bool rootDone = false;
+
+    auto tol = [&](){ return 1e-9*max(1.0, fabs(ub.load())); };
+    auto offer = [&](const OneTree &t){ // all degrees 2: the 1-tree is a tour
+        vector<vector<int>> adj(n);
+        for(auto &e : t.edges){ adj[e.first].push_back(e.second); adj[e.second].push_back(e.first); }
+        vector<int> order; int prev = 0, cur = adj[0][0];
+        double cost = c[cur];
+        while(cur != 0){
+            order.push_back(cur);
+            int nx = adj[cur][0] == prev ? adj[cur][1] : adj[cur][0];
+            cost += c[(size_t)cur*n+nx];
+            prev = cur; cur = nx;
+        }
+        lock_guard<mutex> lk(mu);
+        if(cost < ub.load()){ ub.store(cost); res.cost = cost; res.order = order; }
+    };
+
+    auto worker = [&](){
+        vector<BBNode> local;
+        OneTree t;
+        while(true){
+            BBNode nd;
+            bool isRoot = false;
+            if(!local.empty()){ nd = move(local.back()); local.pop_back(); }
+            else {
+                unique_lock<mutex> lk(mu);
+                idle++;
+                while(pool.empty() && !done){
+                    if(idle == threads){ done = true; cv.notify_all(); break; }
+                    cv.wait(lk);
+                }
+                if(done) return;
+                idle--;
+                nd = move(pool.back()); pool.pop_back();
+                if(!rootDone){ rootDone = true; isRoot = true; }
+            }
+            if(nd.bound >= ub.load() - tol()) continue;
+            explored++;
+            if(!ascend(c, n, nd, ub.load(), isRoot ? 50*n : 30, isRoot ? 2.0 : 0.5, t)) continue;
+            if(isRoot) st.rootBound = t.L;
+            if(t.L >= ub.load() - tol()) continue;
+            int v = -1;
+            for(int i=0;i<n;i++) if(t.deg[i] > 2 && (v < 0 || t.deg[i] > t.deg[v])) v = i;
+            if(v < 0){ offer(t); continue; }
+            // two free tree edges at v, most expensive first
+            vector<pair<double,int>> cand;
+            for(auto &e : t.edges){
+                int o = e.first == v ? e.second : (e.second == v ? e.first : -1);
+                if(o >= 0 && nd.fix[(size_t)v*n+o] == EDGE_FREE) cand.push_back({-(c[(size_t)v*n+o] + nd.pi[o]), o});
+            }
+            if(cand.size() < 2) continue; // cannot happen: v has at most one included edge
+            sort(cand.begin(), cand.end());
+            int e1 = cand[0].second, e2 = cand[1].second;
+            nd.bound = t.L;
+            BBNode a = nd, b = nd, cc = nd;
+            bool okA = fix_edge(a, n, v, e1, EDGE_OUT);
+            bool okB = fix_edge(b, n, v, e1, EDGE_IN) && fix_edge(b, n, v, e2, EDGE_OUT);
+            bool okC = fix_edge(cc, n, v, e1, EDGE_IN) && fix_edge(cc, n, v, e2, EDGE_IN);
+            if(okA) local.push_back(move(a));
+            if(okB) local.push_back(move(b));
+            if(okC) local.push_back(move(cc));
+            if(local.size() > 1){
+                lock_guard<mutex> lk(mu);
+                if((int)pool.size() < threads){
+                    pool.push_back(move(local.front()));
+                    local.erase(local.begin());
+                    cv.notify_one();
+                }
+            }
+        }
+    };
+    vector<thread> ths;
+    for(int i=0;i<threads;i++) ths.emplace_back(worker);
+    for(auto &th : ths) th.join();
+    st.nodes = explored.load();
+    return res;
+}
+
+// ---------- Multi-truck capacitated routing ----------
+// Sweep clustering: order dumpsters by polar angle around the base, starting just
+// after the widest empty angular gap, and cut a new cluster whenever the next
+// dumpster would exceed the truck capacity.
+vector<int> sweep_order(const vector<Dump> &all, double base_x, double base_y){
+    int n = (int)all.size();
+    vector<pair<double,int>> ang(n);
+    for(int i=0;i<n;i++) ang[i] = {atan2(all[i].y-base_y, all[i].x-base_x), i};
+    sort(ang.begin(), ang.end());
+    int start = 0; double widest = -1;
+    for(int i=0;i<n;i++){
+        double gap = (i==0 ? ang[0].first + 2*M_PI : ang[i].first) - ang[(i+n-1)%n].first;
+        if(gap > widest){ widest = gap; start = i; }
+    }
+    vector<int> order(n);
+    for(int k=0;k<n;k++) order[k] = ang[(start+k)%n].second;
+    return order;
+}
+
+vector<vector<int>> pack_sweep(const vector<Dump> &all, const vector<int> &order, double capacity){
+    vector<vector<int>> clusters;
+    double load = 0;
+    for(int i : order){
+        if(clusters.empty() || load + all[i].demand > capacity){ clusters.push_back({}); load = 0; }
+        clusters.back().push_back(i); load += all[i].demand;
+    }
+    return clusters;
+}
+
+vector<vector<int>> sweep_clusters(const vector<Dump> &all, double base_x, double base_y, double capacity){
+    return pack_sweep(all, sweep_order(all, base_x, base_y), capacity);
+}
+
+// Sweep into exactly `count` clusters (count <= dumpsters). Greedy packing is optimal
+// for contiguous runs and its cluster count only falls as capacity grows, so binary
+// search the smallest capacity that fits in `count`, then split the heaviest
+// multi-stop clusters until there are `count`. `capacity` receives the largest load.
+vector<vector<int>> balanced_sweep_clusters(const vector<Dump> &all, double base_x, double base_y, int count, double &capacity){
+    vector<int> order = sweep_order(all, base_x, base_y);
+    double lo = 0, hi = 0;
+    for(auto &d : all){ lo = max(lo, d.demand); hi += d.demand; }
+    if((int)pack_sweep(all, order, lo).size() <= count) hi = lo;
+    for(int it=0; it<100 && hi-lo > 1e-9*hi; it++){
+        double mid = (lo+hi)/2;
+        if((int)pack_sweep(all, order, mid).size() <= count) hi = mid; else lo = mid;
+    }
+    vector<vector<int>> clusters = pack_sweep(all, order, hi);
+    auto load = [&](const vector<int> &c){ double s = 0; for(int i : c) s += all[i].demand; return s; };
+    while((int)clusters.size() < count){
+        int best = -1; double bestLoad = -1;
+        for(int t=0;t<(int)clusters.size();t++)
+            if(clusters[t].size() > 1 && load(clusters[t]) > bestLoad){ best = t; bestLoad = load(clusters[t]); }
+        vector<int> &c = clusters[best];
+        size_t cut = 1; double run = all[c[0]].demand;
+        while(cut+1 < c.size() && run + all[c[cut]].demand <= bestLoad/2){ run += all[c[cut]].demand; cut++; }
+        vector<int> tail(c.begin()+cut, c.end());
+        c.resize(cut);
+        clusters.insert(clusters.begin()+best+1, tail);
+    }
+    capacity = 0;
+    for(auto &c : clusters) capacity = max(capacity, load(c));
+    return clusters;
+}
+
+// Capacitated k-means: centroids start from the given (capacity-feasible) clusters;
+// each round assigns dumpsters in order of regret (second-nearest minus nearest
+// centroid distance) to the nearest centroid that still has room, then moves the
+// centroids. A round that leaves some dumpster with no room anywhere is discarded,
+// so the result has exactly as many clusters as the input, none over capacity.
+vector<vector<int>> kmeans_clusters(const vector<Dump> &all, vector<vector<int>> clusters, double capacity, int rounds = 25){
+    int n = (int)all.size(), T = (int)clusters.size();
+    vector<double> cx(T), cy(T);
+    auto centroids = [&](){
+        for(int t=0;t<T;t++){
+            double sx=0, sy=0;
+            for(int i : clusters[t]){ sx += all[i].x; sy += all[i].y; }
+            if(!clusters[t].empty()){ cx[t] = sx/clusters[t].size(); cy[t] = sy/clusters[t].size(); }
+        }
+    };
+    centroids();
+    vector<int> owner(n, -1);
+    for(int t=0;t<T;t++) for(int i : clusters[t]) owner[i] = t;
+    for(int round=0; round<rounds; round++){
+        vector<pair<double,int>> regret(n);
+        vector<vector<int>> pref(n, vector<int>(T));
+        for(int i=0;i<n;i++){
+            auto &pr = pref[i];
+            iota(pr.begin(), pr.end(), 0);
+            auto d = [&](int t){ return euclid(all[i].x, all[i].y, cx[t], cy[t]); };
+            sort(pr.begin(), pr.end(), [&](int a, int b){ return d(a) < d(b); });
+            regret[i] = {T > 1 ? d(pr[1]) - d(pr[0]) : 0.0, i};
+        }
+        sort(regret.rbegin(), regret.rend());
+        vector<double> load(T, 0);
+        vector<vector<int>> next(T);
+        vector<int> nextOwner(n, -1);
+        bool fits = true;
+        for(auto &r : regret){
+            int i = r.second, t = -1;
+            for(int c : pref[i]) if(load[c] + all[i].demand <= capacity){ t = c; break; }
+            if(t < 0){ fits = false; break; } // keep the last assignment that fit every truck
+            load[t] += all[i].demand; next[t].push_back(i); nextOwner[i] = t;
+        }
+        if(!fits) break;
+        // Keep all T trucks: re-seed an empty cluster with the dumpster farthest from
+        // its centroid (taken from a cluster of two or more, so none is emptied).
+        for(int e=0;e<T;e++){
+            if(!next[e].empty()) continue;
+            int far = -1; double farDist = -1;
+            for(int i=0;i<n;i++){
+                int t = nextOwner[i];
+                double d = euclid(all[i].x, all[i].y, cx[t], cy[t]);
+                if(next[t].size() > 1 && d > farDist){ farDist = d; far = i; }
+            }
+            if(far < 0){ fits = false; break; }
+            auto &src = next[nextOwner[far]];
+            src.erase(find(src.begin(), src.end(), far));
+            next[e].push_back(far); nextOwner[far] = e;
+        }
+        if(!fits) break;
+        bool changed = nextOwner != owner;
+        clusters.swap(next);
+        owner.swap(nextOwner);
+        centroids();
+        if(!changed) break;
+    }
+    return clusters;
+}
+
+struct TruckRoute { vector<Dump> nodes; Tour tour; double load = 0; bool exact = false; };
+
+// Solve every cluster's tour; clusters are handed out to `threads` workers from a
+// shared counter. Clusters of at most dpMax dumpsters use Held-Karp, larger ones the
+// heuristic. `full`, if given, is the matrix over BASE followed by all dumpsters.
+vector<TruckRoute> solve_clusters(const vector<Dump> &all, const vector<vector<int>> &clusters, double base_x, double base_y,
+                                  int dpMax, int neighbors, int threads, const vector<double> *full = nullptr){
+    int T = (int)clusters.size();
+    vector<TruckRoute> routes(T);
+    atomic<int> nextCluster(0);
+    auto worker = [&](){
+        for(int t; (t = nextCluster.fetch_add(1)) < T; ){
+            TruckRoute &r = routes[t];
+            r.nodes = with_base(all, clusters[t], base_x, base_y);
+            for(int i : clusters[t]) r.load += all[i].demand;
+            int M = (int)r.nodes.size(), N = (int)all.size()+1;
+            vector<int> row(M, 0); // node -> row of `full`
+            for(int i=1;i<M;i++) row[i] = clusters[t][i-1]+1;
+            vector<double> dist((size_t)M*M);
+            for(int i=0;i<M;i++) for(int j=0;j<M;j++)
+                dist[(size_t)i*M+j] = full ? (*full)[(size_t)row[i]*N+row[j]]
+                                           : euclid(r.nodes[i].x, r.nodes[i].y, r.nodes[j].x, r.nodes[j].y);
+            if(M-1 <= dpMax){
+                r.tour = held_karp(dist, M, 1);
+                r.exact = true;
+            } else {
+                LocalSearchStats st;
+                r.tour = heuristic_tour(r.nodes, neighbors, false, st, full ? &dist : nullptr);
+            }
+        }
+    };
+    vector<thread> pool;
+    for(int i=0;i<max(1, min(threads, T));i++) pool.emplace_back(worker);
+    for(auto &th : pool) th.join();
+    return routes;
+}
+
+// route.csv with one section per truck, each running BASE -> ... -> BASE
+void write_fleet_route_csv(const string &path, const vector<TruckRoute> &routes){
+    ofstream fout(path);
+    fout<<"truck,sequence,site_id,x,y\n";
+    for(size_t t=0;t<routes.size();t++){
+        const vector<Dump> &nodes = routes[t].nodes;
+        fout<<t+1<<","<<0<<","<<nodes[0].id<<","<<nodes[0].x<<","<<nodes[0].y<<"\n";
+        int seq = 1;
+        for(int idx : routes[t].tour.order)
+            fout<<t+1<<","<<seq++<<","<<nodes[idx].id<<","<<nodes[idx].x<<","<<nodes[idx].y<<"\n";
+        fout<<t+1<<","<<seq<<","<<nodes[0].id<<","<<nodes[0].x<<","<<nodes[0].y<<"\n";
+    }
+}
+
 int main(int argc, char** argv){
     ios::sync_with_stdio(false);
     cin.tie(nullptr);
     if(argc < 2){
-        cerr<<"Usage: "<<argv[0]<<" dumpsters.csv [K=16] [base_x=5000] [base_y=5000]\n";
+        cerr<<"Usage: "<<argv[0]<<" dumpsters.csv [K=16] [base_x=5000] [base_y=5000] [--threads T]\n"
+            <<"       "<<argv[0]<<" dumpsters.csv --heuristic [base_x] [base_y] [--init nn|hilbert] [--neighbors N]\n"
+            <<"       "<<argv[0]<<" dumpsters.csv --bench-heuristic [maxK=18] [base_x] [base_y]\n"
+            <<"       "<<argv[0]<<" dumpsters.csv --trucks T | --capacity C [base_x] [base_y] [--cluster sweep|kmeans] [--dp-max K]\n"
+            <<"       any mode: --roads roads.csv [--matrix-cache file]; exact: --solver auto|dp|bnb\n";
         return 1;
     }
-    string csv = argv[1];
+    int threads = max(1u, thread::hardware_concurrency());
+    bool heuristic = false, benchHeuristic = false, hilbertStart = false;
+    int neighbors = 10;
+    int trucks = 0, dpMax = 12;
+    double capacity = 0;
+    bool kmeans = false;
+    string roadsPath, cachePath, solver = "auto";
+    vector<string> pos;
+    for(int i=1;i<argc;i++){
+        string a = argv[i];
+        if(a=="--threads" && i+1<argc) threads = stoi(argv[++i]);
+        else if(a=="--heuristic") heuristic = true;
+        else if(a=="--bench-heuristic") benchHeuristic = true;
+        else if(a=="--init" && i+1<argc) hilbertStart = string(argv[++i])=="hilbert";
+        else if(a=="--neighbors" && i+1<argc) neighbors = max(1, stoi(argv[++i]));
+        else if(a=="--trucks" && i+1<argc) trucks = stoi(argv[++i]);
+        else if(a=="--capacity" && i+1<argc) capacity = stod(argv[++i]);
+        else if(a=="--cluster" && i+1<argc) kmeans = string(argv[++i])=="kmeans";
+        else if(a=="--solver" && i+1<argc) solver = argv[++i];
+        else if(a=="--roads" && i+1<argc) roadsPath = argv[++i];
+        else if(a=="--matrix-cache" && i+1<argc) cachePath = argv[++i];
+        else if(a=="--dp-max" && i+1<argc) dpMax = min(HELD_KARP_MAX_K, stoi(argv[++i]));
+        else pos.push_back(a);
+    }
+    bool fleet = trucks > 0 || capacity > 0;
+    if((heuristic || fleet) && pos.size() >= 3) pos.insert(pos.begin()+1, "0"); // no K in heuristic mode
+    if(benchHeuristic && pos.size() < 2) pos.push_back("18");
+    if(pos.empty()){ cerr<<"Missing dumpsters.csv\n"; return 1; }
+    string csv = pos[0];
     int K = 16;
     double base_x = 5000.0, base_y = 5000.0;
-    if(argc >= 3) K = stoi(argv[2]);
-    if(argc >= 5){ base_x = stod(argv[3]); base_y = stod(argv[4]); }
+    if(pos.size() >= 2) K = stoi(pos[1]);
+    if(pos.size() >= 4){ base_x = stod(pos[2]); base_y = stod(pos[3]); }
 
     // Read all dumpsters
     vector<Dump> all;
@@ -38,12 +1010,97 @@ int main(int argc, char** argv){
             getline(ss,xs,',');
             getline(ss,ys,',');
             Dump d; d.id=id; d.x=stod(xs); d.y=stod(ys);
+            string ds;
+            if(getline(ss,ds,',') && !ds.empty()) d.demand = stod(ds);
             all.push_back(d);
         }
     }
     if(all.empty()){ cerr<<"No dumpsters loaded\n"; return 1; }
     cout<<"Loaded "<<all.size()<<" dumpsters.\n";
 
+    RoadGraph roadGraph;
+    const RoadGraph *roads = nullptr;
+    if(!roadsPath.empty()){
+        string err;
+        if(!load_road_graph(roadsPath, roadGraph, err)){ cerr<<err<<"\n"; return 1; }
+        roads = &roadGraph;
+        if(cachePath.empty()) cachePath = roadsPath + ".matrix.bin";
+        cout<<"Road graph: "<<roadGraph.pts.size()<<" nodes, "<<roadGraph.to.size()<<" arcs\n";
+    }
+
+    if(benchHeuristic){
+        run_heuristic_benchmark(all, base_x, base_y, min(K, 24), neighbors, hilbertStart, threads);
+        return 0;
+    }
+    if(fleet){
+        double total = 0;
+        for(auto &d : all) total += d.demand;
+        if(trucks > (int)all.size()){ cerr<<trucks<<" trucks requested for only "<<all.size()<<" dumpsters\n"; return 1; }
+        double maxDemand = 0;
+        for(auto &d : all) maxDemand = max(maxDemand, d.demand);
+        if(capacity > 0 && maxDemand > capacity){ cerr<<"A dumpster's demand exceeds truck capacity "<<capacity<<"\n"; return 1; }
+        vector<double> full;
+        if(roads){
+            vector<int> pick(all.size()); iota(pick.begin(), pick.end(), 0);
+            if(!distance_matrix(with_base(all, pick, base_x, base_y), roads, cachePath, threads, full)) return 1;
+        }
+        auto t0 = chrono::high_resolution_clock::now();
+        // --trucks alone: exactly that many trucks, capacity set by the heaviest balanced cluster.
+        vector<vector<int>> clusters = capacity <= 0 ? balanced_sweep_clusters(all, base_x, base_y, trucks, capacity)
+                                                     : sweep_clusters(all, base_x, base_y, capacity);
+        if(trucks > 0 && (int)clusters.size() > trucks){
+            cerr<<"Capacity "<<capacity<<" needs "<<clusters.size()<<" trucks, only "<<trucks<<" available (total demand "<<total<<")\n";
+            return 1;
+        }
+        if(kmeans) clusters = kmeans_clusters(all, clusters, capacity);
+        auto t1 = chrono::high_resolution_clock::now();
+        vector<TruckRoute> routes = solve_clusters(all, clusters, base_x, base_y, dpMax, neighbors, threads, roads ? &full : nullptr);
+        auto t2 = chrono::high_resolution_clock::now();
+        int overloaded = 0;
+        for(size_t t=0;t<routes.size();t++)
+            if(routes[t].load > capacity*(1+1e-12)){
+                cerr<<"Truck "<<t+1<<" load "<<routes[t].load<<" exceeds capacity "<<capacity<<"\n";
+                overloaded++;
+            }
+        if(overloaded) return 1;
+        cout<<(kmeans ? "k-means" : "sweep")<<" clustering: "<<routes.size()<<" trucks, capacity "<<capacity
+            <<" ("<<chrono::duration<double,milli>(t1-t0).count()<<" ms)\n";
+        double sum = 0;
+        for(size_t t=0;t<routes.size();t++){
+            cout<<"Truck "<<t+1<<": "<<routes[t].tour.order.size()<<" stops, load "<<routes[t].load
+                <<", cost "<<fixed<<setprecision(3)<<routes[t].tour.cost<<(routes[t].exact ? " (exact)" : " (heuristic)")<<"\n";
+            cout.unsetf(ios::floatfield);
+            sum += routes[t].tour.cost;
+        }
+        cout<<"Total cost: "<<fixed<<setprecision(6)<<sum<<"\n";
+        cout.unsetf(ios::floatfield);
+        cout<<"Routing time: "<<chrono::duration<double>(t2-t1).count()<<" s, threads="<<threads<<"\n";
+        write_fleet_route_csv("route.csv", routes);
+        cout<<"Wrote route.csv with one section per truck.\n";
+        return 0;
+    }
+    if(heuristic){
+        vector<int> pick(all.size()); iota(pick.begin(), pick.end(), 0);
+        vector<Dump> nodes = with_base(all, pick, base_x, base_y);
+        cout<<"Heuristic tour over all "<<all.size()<<" dumpsters ("<<(hilbertStart ? "hilbert" : "nearest-neighbour")
+            <<" start, "<<neighbors<<" candidates)\n";
+        vector<double> dist;
+        if(roads){
+            if(nodes.size() > 20000){ cerr<<"Road matrix for "<<nodes.size()<<" nodes is too large\n"; return 1; }
+            if(!distance_matrix(nodes, roads, cachePath, threads, dist)) return 1;
+        }
+        auto t0 = chrono::high_resolution_clock::now();
+        LocalSearchStats st;
+        Tour tour = heuristic_tour(nodes, neighbors, hilbertStart, st, roads ? &dist : nullptr);
+        auto t1 = chrono::high_resolution_clock::now();
+        cout<<"Heuristic time: "<<chrono::duration<double>(t1-t0).count()<<" s (2-opt moves "<<st.twoOpt
+            <<", or-opt moves "<<st.orOpt<<")\n";
+        cout<<"Tour cost: "<<fixed<<setprecision(6)<<tour.cost<<"\n";
+        write_route_csv("route.csv", nodes, tour.order);
+        cout<<"Wrote route.csv with sequence (BASE start and end).\n";
+        return 0;
+    }
+
     // Select K nearest to base
     int N_all = (int)all.size();
     vector<pair<double,int>> dist_idx;
@@ -63,65 +1120,46 @@ int main(int argc, char** argv){
     }
     cout<<"Solving exact TSP for K="<<K<<" nearest dumpsters (node count incl. base = "<<K+1<<")\n";
 
-    // Build distance matrix (size K+1)
+    bool useDP = solver=="dp" || (solver=="auto" && K <= 20);
+    if(useDP && K > HELD_KARP_MAX_K){
+        double need_gb = (double)K*(1ULL<<(K-1))*(sizeof(double)+1)/1073741824.0;
+        cerr<<"K="<<K<<" is too large for Held-Karp (table would need "<<fixed<<setprecision(1)<<need_gb
+            <<" GB, limit K="<<HELD_KARP_MAX_K<<"), use --solver bnb\n";
+        return 1;
+    }
+    // Build distance matrix (size K+1), flat row-major
     int M = K+1;
-    vector<vector<double>> dist(M, vector<double>(M,0.0));
-    for(int i=0;i<M;i++) for(int j=0;j<M;j++)
-        dist[i][j] = euclid(nodes[i].x, nodes[i].y, nodes[j].x, nodes[j].y);
+    vector<double> dist;
+    if(!distance_matrix(nodes, roads, cachePath, threads, dist)) return 1;
 
-    // DP: masks over K dumpsters (bits 0..K-1 correspond to nodes 1..K)
-    int FULL = 1<<K;
-    const double INF = 1e18;
-    // dp[mask][last] where last in 1..K; store parent for reconstruction
-    vector<vector<double>> dp(FULL, vector<double>(K+1, INF));
-    vector<vector<int>> parent(FULL, vector<int>(K+1, -1));
-
-    // Initialize
-    for(int i=1;i<=K;i++){
-        int mask = 1<<(i-1);
-        dp[mask][i] = dist[0][i]; // base -> i
-        parent[mask][i] = 0;
-    }
-
-    // Iterate masks
-    for(int mask=0; mask<FULL; ++mask){
-        for(int last=1; last<=K; ++last){
-            if(!(mask & (1<<(last-1)))) continue;
-            double cur = dp[mask][last];
-            if(cur >= INF) continue;
-            // Try to go to next
-            for(int nxt=1; nxt<=K; ++nxt){
-                if(mask & (1<<(nxt-1))) continue;
-                int nmask = mask | (1<<(nxt-1));
-                double cand = cur + dist[last][nxt];
-                if(cand < dp[nmask][nxt]){
-                    dp[nmask][nxt] = cand;
-                    parent[nmask][nxt] = last;
-                }
+    Tour tour;
+    if(useDP){
+        double mem_mb = K > 0 ? (double)K*(1ULL<<(K-1))*(sizeof(double)+1)/1048576.0 : 0.0;
+        cout<<"DP table: "<<fixed<<setprecision(1)<<mem_mb<<" MB, threads="<<threads<<"\n";
+        cout.unsetf(ios::floatfield); cout<<setprecision(6);
+        auto t0 = chrono::high_resolution_clock::now();
+        tour = held_karp(dist, M, threads);
+        auto t1 = chrono::high_resolution_clock::now();
+        cout<<"Held-Karp time: "<<chrono::duration<double>(t1-t0).count()<<" s\n";
+    } else {
+        for(int i=0;i<M;i++) for(int j=0;j<i;j++)
+            if(fabs(dist[(size_t)i*M+j] - dist[(size_t)j*M+i]) > 1e-9){
+                cerr<<"Branch and bound needs symmetric distances (one-way roads present), use --solver dp\n";
+                return 1;
             }
-        }
-    }
-
-    // Close tour: full mask
-    int fullmask = FULL - 1;
-    double best = INF; int lastBest = -1;
-    for(int last=1; last<=K; ++last){
-        double cand = dp[fullmask][last] + dist[last][0];
-        if(cand < best){ best = cand; lastBest = last; }
+        auto t0 = chrono::high_resolution_clock::now();
+        LocalSearchStats lst;
+        Tour init = heuristic_tour(nodes, neighbors, false, lst, &dist);
+        BBStats bst;
+        tour = branch_and_bound(dist, M, threads, init, bst);
+        auto t1 = chrono::high_resolution_clock::now();
+        cout<<"Branch and bound time: "<<chrono::duration<double>(t1-t0).count()<<" s, threads="<<threads
+            <<" (search nodes "<<bst.nodes<<", root bound "<<fixed<<setprecision(3)<<bst.rootBound
+            <<", heuristic start "<<init.cost<<")\n";
+        cout.unsetf(ios::floatfield); cout<<setprecision(6);
     }
-    if(best >= INF){ cerr<<"No tour found\n"; return 1; }
-
-    // Reconstruct path
-    vector<int> pathNodes; // indices into nodes (0..K), start at base, visit in order, return base
-    int curMask = fullmask;
-    int curLast = lastBest;
-    while(curLast != 0){
-        pathNodes.push_back(curLast);
-        int p = parent[curMask][curLast];
-        curMask ^= 1<<(curLast-1);
-        curLast = p;
-    }
-    reverse(pathNodes.begin(), pathNodes.end());
+    double best = tour.cost;
+    vector<int> &pathNodes = tour.order; // indices into nodes (1..K), base implied at both ends
     // Output full route including base at start and end
     cout<<"Optimal tour cost (approx): "<<fixed<<setprecision(6)<<best<<"\n";
     cout<<"Route: BASE -> ";
@@ -129,15 +1167,7 @@ int main(int argc, char** argv){
     cout<<"BASE\n";
 
     // Write route.csv
-    ofstream fout("route.csv");
-    fout<<"sequence,site_id,x,y\n";
-    fout<<0<<","<<nodes[0].id<<","<<nodes[0].x<<","<<nodes[0].y<<"\n";
-    int seq = 1;
-    for(int idx : pathNodes){
-        fout<<seq++<<","<<nodes[idx].id<<","<<nodes[idx].x<<","<<nodes[idx].y<<"\n";
-    }
-    fout<<seq<<","<<nodes[0].id<<","<<nodes[0].x<<","<<nodes[0].y<<"\n";
-    fout.close();
+    write_route_csv("route.csv", nodes, pathNodes);
     cout<<"Wrote route.csv with sequence (BASE start and end).\n";
 
     return 0;
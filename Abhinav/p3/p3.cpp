@@ -1,16 +1,31 @@
 // multi_source_bfs_expanded.cpp
 // Expanded and fully commented Multi-Source BFS implementation.
-// Compile with: g++ -std=c++17 -O2 -o multi_source_bfs_expanded multi_source_bfs_expanded.cpp
-// Usage: ./multi_source_bfs_expanded graph_with_stations.csv
+// Compile with: g++ -std=c++17 -O2 -pthread -o multi_source_bfs_expanded multi_source_bfs_expanded.cpp
+// Usage: ./multi_source_bfs_expanded graph_with_stations.csv [--threads T]
+//        [--open NODE]... [--close NODE]...   apply station changes incrementally before writing
+//        [--what-if K] [--seed S]             score K random candidate sites (open, measure, close)
+//        [--topk K] [--within D]              K nearest stations per node; list nodes with < K within D edges
+//        [--save-snapshot FILE]               write the parsed graph as a binary snapshot
+//        [--weighted]                         shortest paths over edge weights instead of hop counts
+//        [--capacity C] [--spill-k K]         each station serves <= C nodes; excess spills to the
+//                                             next nearest of a node's K nearest stations
 //
 // Input CSV format (header required):
-// type,u,v
-// - type = "E" for undirected edge between integer nodes u and v
+// type,u,v[,w]
+// - type = "E" for undirected edge between integer nodes u and v, with an optional
+//   positive integer weight w (travel cost; 1 when omitted)
 // - type = "S" for a fire station at node u (v column can be empty)
 // Nodes should be positive integers (1..N). The program auto-detects the max node id.
+// The input may also be a binary snapshot written earlier with --save-snapshot FILE;
+// snapshots are detected by their magic bytes and memory-mapped instead of parsed.
 // Output: distances.csv with columns node_id,distance,nearest_station
+// When several stations are equally near, nearest_station is the lowest station id.
 
 #include <bits/stdc++.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 using namespace std;
 
 // ------------------------------ Utilities ----------------------------------
@@ -58,6 +73,8 @@ void split_line_csv3(const string &line, string &a, string &b, string &c) {
 struct GraphData {
     int max_node = 0;                 // maximum node index discovered
     vector<pair<int,int>> edges;      // undirected edges (u,v)
+    vector<int> weights;              // weight of each edge (1 unless the row has a w column)
+    bool weighted = false;            // true if any edge row carried a weight
     vector<int> stations;             // list of station node IDs
 };
 
@@ -104,6 +121,22 @@ bool read_graph_csv(const string &filename, GraphData &out, string &err) {
                 cerr << "Warning: malformed edge at line " << line_no << " (missing u or v). Skipping.\n";
                 continue;
             }
+            // optional weight: "E,u,v,w" leaves "v,w" in the last field
+            int w = 1;
+            size_t comma = vs.find(',');
+            if (comma != string::npos) {
+                string ws = vs.substr(comma + 1);
+                vs = vs.substr(0, comma);
+                trim_inplace(vs); trim_inplace(ws);
+                if (!ws.empty()) {
+                    w = safe_stoi(ws);
+                    if (w <= 0) {
+                        cerr << "Warning: weight must be a positive integer at line " << line_no << ". Skipping.\n";
+                        continue;
+                    }
+                    out.weighted = true;
+                }
+            }
             int u = safe_stoi(us);
             int v = safe_stoi(vs);
             if (u <= 0 || v <= 0) {
@@ -115,6 +148,7 @@ bool read_graph_csv(const string &filename, GraphData &out, string &err) {
                 continue;
             }
             out.edges.emplace_back(u, v);
+            out.weights.push_back(w);
             out.max_node = max(out.max_node, max(u, v));
         } else if (type == "S") {
             if (us.empty()) {
@@ -139,45 +173,850 @@ bool read_graph_csv(const string &filename, GraphData &out, string &err) {
     return true;
 }
 
+// ------------------------------ CSR Graph ----------------------------------
+
+// Compressed sparse row adjacency: the neighbors of node u are
+// neighbors[offsets[u] .. offsets[u+1]). Nodes are 1..n, index 0 is unused.
+// Every undirected edge is stored in both directions.
+// Weighted graphs carry weights[] parallel to neighbors[]; unweighted graphs
+// leave it null and every edge costs 1.
+// The arrays are either owned (built from CSV) or point into a memory-mapped
+// snapshot; `mapping` keeps such a mapping alive for as long as the graph.
+struct CSRGraph {
+    int n = 0;
+    const int64_t *offsets = nullptr;   // size n + 2
+    const int *neighbors = nullptr;     // size num_arcs
+    const int *weights = nullptr;       // size num_arcs, or null when unweighted
+    int64_t num_arcs = 0;               // directed arcs (2 x undirected edges)
+    int max_weight = 1;
+    int64_t degree(int u) const { return offsets[u + 1] - offsets[u]; }
+    int weight(int64_t e) const { return weights ? weights[e] : 1; }
+
+    vector<int64_t> offsets_store;      // owned storage, empty when mapped
+    vector<int> neighbors_store;
+    vector<int> weights_store;
+    shared_ptr<void> mapping;
+
+    CSRGraph() = default;
+    CSRGraph(CSRGraph &&) = default;    // vector moves keep their buffers, so the pointers stay valid
+    CSRGraph &operator=(CSRGraph &&) = default;
+    CSRGraph(const CSRGraph &) = delete;
+    CSRGraph &operator=(const CSRGraph &) = delete;
+};
+
+// Build CSR from an undirected edge list. Out-of-range ids and self-loops are
+// dropped, duplicate edges are removed by sorting each row (no hash set needed).
+// If weights (one per edge) are given, the cheapest of duplicate edges is kept.
+CSRGraph build_csr(int n, const vector<pair<int,int>> &edges, const vector<int> &weights = {}) {
+    vector<int64_t> offsets(n + 2, 0);
+    vector<int> nbrs, wts;
+    const bool weighted = !weights.empty();
+    auto valid = [n](int u, int v) { return u > 0 && v > 0 && u <= n && v <= n && u != v; };
+
+    // Count degrees, prefix-sum into offsets, then scatter
+    for (auto &e : edges) {
+        if (!valid(e.first, e.second)) continue;
+        ++offsets[e.first + 1];
+        ++offsets[e.second + 1];
+    }
+    for (int u = 1; u <= n + 1; ++u) offsets[u] += offsets[u - 1];
+    nbrs.resize(offsets[n + 1]);
+    if (weighted) wts.resize(offsets[n + 1]);
+    vector<int64_t> fill_pos(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < edges.size(); ++i) {
+        int u = edges[i].first, v = edges[i].second;
+        if (!valid(u, v)) continue;
+        if (weighted) {
+            wts[fill_pos[u]] = weights[i];
+            wts[fill_pos[v]] = weights[i];
+        }
+        nbrs[fill_pos[u]++] = v;
+        nbrs[fill_pos[v]++] = u;
+    }
+
+    // Sort + unique every row and compact in place
+    int64_t write = 0;
+    int max_weight = 1;
+    vector<pair<int,int>> row; // (neighbor, weight) scratch for weighted rows
+    for (int u = 1; u <= n; ++u) {
+        int64_t begin = offsets[u], end = offsets[u + 1];
+        int64_t row_start = write;
+        if (weighted) {
+            row.clear();
+            for (int64_t i = begin; i < end; ++i) row.push_back({nbrs[i], wts[i]});
+            sort(row.begin(), row.end());
+            for (size_t i = 0; i < row.size(); ++i) {
+                if (i > 0 && row[i].first == row[i - 1].first) continue;
+                nbrs[write] = row[i].first;
+                wts[write++] = row[i].second;
+                max_weight = max(max_weight, row[i].second);
+            }
+        } else {
+            sort(nbrs.begin() + begin, nbrs.begin() + end);
+            for (int64_t i = begin; i < end; ++i) {
+                if (i > begin && nbrs[i] == nbrs[i - 1]) continue;
+                nbrs[write++] = nbrs[i];
+            }
+        }
+        offsets[u] = row_start;
+    }
+    offsets[n + 1] = write;
+    nbrs.resize(write);
+    nbrs.shrink_to_fit();
+    wts.resize(weighted ? write : 0);
+    wts.shrink_to_fit();
+
+    CSRGraph g;
+    g.n = n;
+    g.num_arcs = write;
+    g.max_weight = max_weight;
+    g.offsets_store = move(offsets);
+    g.neighbors_store = move(nbrs);
+    g.weights_store = move(wts);
+    g.offsets = g.offsets_store.data();
+    g.neighbors = g.neighbors_store.data();
+    g.weights = weighted ? g.weights_store.data() : nullptr;
+    return g;
+}
+
+// --------------------------- Binary Snapshot -------------------------------
+
+// A snapshot is the already-deduplicated CSR graph plus the station list, laid
+// out so that it can be mmap'd and used in place:
+//   SnapshotHeader | offsets int64[n+2] | neighbors int32[num_arcs] | stations int32[]
+//   [| weights int32[num_arcs]]   (version 2, weighted graphs only)
+// Every section starts at an 8-byte aligned file offset recorded in the header.
+// Integers are stored in host byte order (the magic doubles as an endianness check).
+// Version 1 files (no weight fields in the header) are still accepted.
+static const char SNAPSHOT_MAGIC[8] = {'M','S','B','F','S','N','A','P'};
+static const uint32_t SNAPSHOT_VERSION = 2;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t n;
+    uint64_t num_arcs;
+    uint64_t num_stations;
+    uint64_t offsets_pos;
+    uint64_t neighbors_pos;
+    uint64_t stations_pos;
+    uint64_t file_size;
+    // version 2
+    uint64_t weights_pos;   // 0 when unweighted
+    uint64_t max_weight;
+};
+static const uint32_t SNAPSHOT_V1_HEADER_SIZE = offsetof(SnapshotHeader, weights_pos);
+
+static inline uint64_t align8(uint64_t x) { return (x + 7) & ~(uint64_t)7; }
+
+// True if the file starts with the snapshot magic (so it is not a CSV).
+bool is_snapshot_file(const string &filename) {
+    ifstream fin(filename, ios::binary);
+    char magic[8] = {0};
+    fin.read(magic, 8);
+    return fin && memcmp(magic, SNAPSHOT_MAGIC, 8) == 0;
+}
+
+bool write_snapshot(const string &filename, const CSRGraph &g, const vector<int> &stations, string &err) {
+    SnapshotHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SNAPSHOT_MAGIC, 8);
+    h.version = SNAPSHOT_VERSION;
+    h.header_size = sizeof(SnapshotHeader);
+    h.n = (uint64_t)g.n;
+    h.num_arcs = (uint64_t)g.num_arcs;
+    h.num_stations = stations.size();
+    h.offsets_pos = align8(sizeof(SnapshotHeader));
+    h.neighbors_pos = align8(h.offsets_pos + (h.n + 2) * sizeof(int64_t));
+    h.stations_pos = align8(h.neighbors_pos + h.num_arcs * sizeof(int));
+    h.file_size = h.stations_pos + h.num_stations * sizeof(int);
+    h.max_weight = (uint64_t)g.max_weight;
+    if (g.weights) {
+        h.weights_pos = align8(h.file_size);
+        h.file_size = h.weights_pos + h.num_arcs * sizeof(int);
+    }
+
+    // Write to a temporary name and rename, so a crash never leaves a torn snapshot
+    string tmp = filename + ".tmp";
+    ofstream fout(tmp, ios::binary | ios::trunc);
+    if (!fout.is_open()) {
+        err = "Cannot open file for writing: " + tmp;
+        return false;
+    }
+    auto pad_to = [&](uint64_t pos) {
+        static const char zeros[8] = {0};
+        uint64_t cur = (uint64_t)fout.tellp();
+        if (pos > cur) fout.write(zeros, (streamsize)(pos - cur));
+    };
+    fout.write((const char*)&h, sizeof(h));
+    pad_to(h.offsets_pos);
+    fout.write((const char*)g.offsets, (streamsize)((h.n + 2) * sizeof(int64_t)));
+    pad_to(h.neighbors_pos);
+    fout.write((const char*)g.neighbors, (streamsize)(h.num_arcs * sizeof(int)));
+    pad_to(h.stations_pos);
+    fout.write((const char*)stations.data(), (streamsize)(h.num_stations * sizeof(int)));
+    if (g.weights) {
+        pad_to(h.weights_pos);
+        fout.write((const char*)g.weights, (streamsize)(h.num_arcs * sizeof(int)));
+    }
+    fout.close();
+    if (!fout) {
+        err = "Write failed for " + tmp;
+        return false;
+    }
+    if (rename(tmp.c_str(), filename.c_str()) != 0) {
+        err = "Cannot rename " + tmp + " to " + filename;
+        return false;
+    }
+    return true;
+}
+
+// Map a snapshot read-only; the graph arrays point straight into the mapping, so
+// load time does not depend on graph size (pages are faulted in on first use).
+// Only O(1) consistency checks are made here.
+bool load_snapshot(const string &filename, CSRGraph &g, vector<int> &stations, string &err) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        err = "Cannot open file: " + filename;
+        return false;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) != 0 || (size_t)sb.st_size < sizeof(SnapshotHeader)) {
+        close(fd);
+        err = "Snapshot too small: " + filename;
+        return false;
+    }
+    size_t size = (size_t)sb.st_size;
+    void *base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping stays valid after close
+    if (base == MAP_FAILED) {
+        err = "mmap failed for " + filename;
+        return false;
+    }
+    shared_ptr<void> mapping(base, [size](void *p) { munmap(p, size); });
+
+    // Copy the header, zero-filling the version 2 fields for version 1 files
+    SnapshotHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(&h, base, min(size, sizeof(SnapshotHeader)));
+    if (memcmp(h.magic, SNAPSHOT_MAGIC, 8) != 0) {
+        err = "Not a graph snapshot (or written on a machine with different byte order): " + filename;
+        return false;
+    }
+    if (h.version == 1 && h.header_size == SNAPSHOT_V1_HEADER_SIZE) {
+        h.weights_pos = 0;
+        h.max_weight = 1;
+    } else if (h.version != SNAPSHOT_VERSION || h.header_size != sizeof(SnapshotHeader)) {
+        err = "Unsupported snapshot version " + to_string(h.version) + " in " + filename;
+        return false;
+    }
+    uint64_t stations_end = h.stations_pos + h.num_stations * sizeof(int);
+    uint64_t data_end = h.weights_pos ? h.weights_pos + h.num_arcs * sizeof(int) : stations_end;
+    if (h.file_size != size || h.n == 0 || h.n >= (uint64_t)INT_MAX ||
+        h.offsets_pos < h.header_size ||
+        h.offsets_pos + (h.n + 2) * sizeof(int64_t) > h.neighbors_pos ||
+        h.neighbors_pos + h.num_arcs * sizeof(int) > h.stations_pos ||
+        (h.weights_pos && h.weights_pos < stations_end) ||
+        data_end != size || h.max_weight == 0 || h.max_weight > (uint64_t)INT_MAX) {
+        err = "Corrupt or truncated snapshot: " + filename;
+        return false;
+    }
+    const char *bytes = (const char*)base;
+    g = CSRGraph();
+    g.n = (int)h.n;
+    g.num_arcs = (int64_t)h.num_arcs;
+    g.offsets = (const int64_t*)(bytes + h.offsets_pos);
+    g.neighbors = (const int*)(bytes + h.neighbors_pos);
+    g.weights = h.weights_pos ? (const int*)(bytes + h.weights_pos) : nullptr;
+    g.max_weight = (int)h.max_weight;
+    if (g.offsets[1] != 0 || g.offsets[g.n + 1] != g.num_arcs) {
+        err = "Corrupt snapshot offsets: " + filename;
+        return false;
+    }
+    g.mapping = mapping;
+    const int *st = (const int*)(bytes + h.stations_pos);
+    stations.assign(st, st + h.num_stations);
+    // Hint the kernel that BFS touches the arrays all over the place
+    madvise(base, size, MADV_RANDOM);
+    return true;
+}
+
 // ---------------------- Multi-source BFS Logic -----------------------------
 
-// Run multi-source BFS on adjacency list adj (1-indexed nodes).
-// stations: list of starting nodes
-// Returns: pair(distances vector, origin stations vector)
-// distances: -1 for unreachable, otherwise min distance (#edges) from nearest station
-// origin: for each node the station id that is nearest (0 if unreachable)
-pair<vector<int>, vector<int>> multi_source_bfs(const vector<vector<int>> &adj, const vector<int> &stations) {
-    int n = (int)adj.size() - 1; // adj is 1..n
-    vector<int> dist(n + 1, -1);
-    vector<int> origin(n + 1, 0);
-    deque<int> q;
-
-    // Initialize with stations
+// Reusable barrier for a fixed number of threads (std::barrier is C++20).
+class Barrier {
+public:
+    explicit Barrier(int count) : count_(count) {}
+    void wait() {
+        unique_lock<mutex> lk(m_);
+        int gen = generation_;
+        if (++arrived_ == count_) {
+            arrived_ = 0;
+            ++generation_;
+            cv_.notify_all();
+        } else {
+            cv_.wait(lk, [&] { return gen != generation_; });
+        }
+    }
+private:
+    mutex m_;
+    condition_variable cv_;
+    int count_, arrived_ = 0, generation_ = 0;
+};
+
+struct BFSStats {
+    int levels = 0;            // BFS levels expanded
+    int bottom_up_levels = 0;  // how many of them ran bottom-up
+    int64_t edges_scanned = 0; // adjacency entries inspected
+};
+
+// Direction-optimizing multi-source BFS (Beamer et al.) over a CSR graph.
+// stations: list of starting nodes (invalid / duplicate ids are ignored)
+// dist:   -1 for unreachable, otherwise min distance (#edges) from nearest station
+// origin: the nearest station (lowest id on ties), 0 if unreachable
+//
+// Each level runs either top-down (threads expand the frontier queue and claim
+// unvisited neighbors with a CAS on dist) or bottom-up (threads
+// scan unvisited nodes, 64 at a time, for a neighbor in the frontier bitmap).
+// We go bottom-up once the frontier's edges exceed 1/alpha of the unexplored
+// edges and return top-down when the frontier drops below n/beta nodes.
+// A node's origin is the minimum origin over its neighbors on the previous
+// level, so the result does not depend on thread scheduling.
+void multi_source_bfs(const CSRGraph &g, const vector<int> &stations, int threads,
+                      vector<int> &dist, vector<int> &origin, BFSStats *stats = nullptr) {
+    const int n = g.n;
+    const int64_t alpha = 14, beta = 24;
+    const size_t words = (size_t)(n + 1 + 63) / 64;
+    threads = max(1, threads);
+
+    dist.assign(n + 1, -1);
+    origin.assign(n + 1, 0);
+    vector<atomic<uint64_t>> visited(words);
+    vector<uint64_t> frontier_bits(words, 0), next_bits(words, 0);
+    for (auto &w : visited) w.store(0, memory_order_relaxed);
+    visited[0].store(1, memory_order_relaxed); // node 0 is not a real node
+
+    vector<int> frontier;
+    int64_t unexplored_edges = g.num_arcs;
     for (int s : stations) {
         if (s <= 0 || s > n) continue;
         if (dist[s] == 0) continue; // duplicate station entry skip
         dist[s] = 0;
         origin[s] = s;
-        q.push_back(s);
+        visited[s >> 6].fetch_or(1ULL << (s & 63), memory_order_relaxed);
+        frontier.push_back(s);
+        unexplored_edges -= g.degree(s);
     }
 
-    // Standard BFS
-    while (!q.empty()) {
-        int u = q.front();
-        q.pop_front();
-        // iterate neighbors
-        for (int v : adj[u]) {
-            if (v <= 0 || v > n) continue;
-            if (dist[v] == -1) {
-                dist[v] = dist[u] + 1;
-                origin[v] = origin[u]; // propagate which station reached it
-                q.push_back(v);
+    // Shared per-level state; written by thread 0 between barriers
+    bool bottom_up = false, finished = frontier.empty();
+    int level = 0;
+    atomic<size_t> next_chunk(0);
+    atomic<int64_t> level_nodes(0), level_edges(0), scanned(0);
+    vector<vector<int>> local_next(threads);
+    BFSStats st;
+    Barrier barrier(threads);
+
+    auto worker = [&](int tid) {
+        const size_t td_chunk = 1024, bu_chunk = 64; // frontier entries / bitmap words
+        while (true) {
+            if (finished) return;
+            int64_t my_nodes = 0, my_edges = 0, my_scanned = 0;
+            if (!bottom_up) {
+                // Top-down: claim unvisited neighbors of the frontier by CAS on
+                // dist; every parent on this level then lowers the child's origin.
+                vector<int> &mine = local_next[tid];
+                mine.clear();
+                const int next_level = level + 1;
+                for (size_t c; (c = next_chunk.fetch_add(td_chunk)) < frontier.size(); ) {
+                    size_t end = min(frontier.size(), c + td_chunk);
+                    for (size_t i = c; i < end; ++i) {
+                        int u = frontier[i], ou = origin[u];
+                        for (int64_t e = g.offsets[u]; e < g.offsets[u + 1]; ++e) {
+                            int v = g.neighbors[e];
+                            int dv = __atomic_load_n(&dist[v], __ATOMIC_RELAXED);
+                            if (dv == -1) {
+                                if (__atomic_compare_exchange_n(&dist[v], &dv, next_level, false,
+                                                                __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                                    visited[v >> 6].fetch_or(1ULL << (v & 63), memory_order_relaxed);
+                                    mine.push_back(v);
+                                    my_edges += g.degree(v);
+                                    dv = next_level;
+                                }
+                            }
+                            if (dv != next_level) continue;
+                            int ov = __atomic_load_n(&origin[v], __ATOMIC_RELAXED);
+                            while ((ov == 0 || ou < ov) &&
+                                   !__atomic_compare_exchange_n(&origin[v], &ov, ou, false,
+                                                                __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+                        }
+                        my_scanned += g.degree(u);
+                    }
+                }
+                my_nodes = (int64_t)mine.size();
+            } else {
+                // Bottom-up: every unvisited node looks for a parent in the frontier.
+                // Threads own whole bitmap words, so no atomics are needed here.
+                for (size_t c; (c = next_chunk.fetch_add(bu_chunk)) < words; ) {
+                    size_t end = min(words, c + bu_chunk);
+                    for (size_t w = c; w < end; ++w) {
+                        uint64_t seen = visited[w].load(memory_order_relaxed);
+                        uint64_t found = 0;
+                        for (uint64_t todo = ~seen; todo; todo &= todo - 1) {
+                            int v = (int)(w * 64 + __builtin_ctzll(todo));
+                            if (v > n) break;
+                            int best = 0;
+                            for (int64_t e = g.offsets[v]; e < g.offsets[v + 1]; ++e) {
+                                int u = g.neighbors[e];
+                                if ((frontier_bits[u >> 6] >> (u & 63)) & 1ULL) {
+                                    if (best == 0 || origin[u] < best) best = origin[u];
+                                }
+                            }
+                            my_scanned += g.degree(v);
+                            if (best == 0) continue;
+                            found |= 1ULL << (v & 63);
+                            dist[v] = level + 1;
+                            origin[v] = best;
+                            ++my_nodes;
+                            my_edges += g.degree(v);
+                        }
+                        next_bits[w] = found;
+                        if (found) visited[w].store(seen | found, memory_order_relaxed);
+                    }
+                }
+            }
+            level_nodes += my_nodes;
+            level_edges += my_edges;
+            scanned += my_scanned;
+            barrier.wait();
+
+            if (tid == 0) {
+                // Bookkeeping: build the next frontier in the representation
+                // the next level wants, and pick that level's direction.
+                int64_t nf = level_nodes.exchange(0), mf = level_edges.exchange(0);
+                unexplored_edges -= mf;
+                ++st.levels;
+                if (bottom_up) ++st.bottom_up_levels;
+                bool next_bottom_up = bottom_up ? (nf >= n / beta) : (mf > unexplored_edges / alpha);
+                if (nf == 0) {
+                    finished = true;
+                } else if (next_bottom_up) {
+                    if (bottom_up) {
+                        frontier_bits.swap(next_bits);
+                    } else {
+                        fill(frontier_bits.begin(), frontier_bits.end(), 0);
+                        for (auto &l : local_next)
+                            for (int v : l) frontier_bits[v >> 6] |= 1ULL << (v & 63);
+                    }
+                } else {
+                    frontier.clear();
+                    if (bottom_up) {
+                        for (size_t w = 0; w < words; ++w)
+                            for (uint64_t b = next_bits[w]; b; b &= b - 1)
+                                frontier.push_back((int)(w * 64 + __builtin_ctzll(b)));
+                    } else {
+                        for (auto &l : local_next) frontier.insert(frontier.end(), l.begin(), l.end());
+                    }
+                }
+                bottom_up = next_bottom_up;
+                ++level;
+                next_chunk.store(0);
+            }
+            barrier.wait();
+        }
+    };
+
+    vector<thread> pool;
+    for (int t = 1; t < threads; ++t) pool.emplace_back(worker, t);
+    worker(0);
+    for (auto &th : pool) th.join();
+
+    st.edges_scanned = scanned.load();
+    if (stats) *stats = st;
+}
+
+// ------------------- Top-k nearest stations --------------------------------
+
+// The k closest distinct stations of every node, stored flat: label r of node v
+// lives at index v * k + r, in ascending distance (lowest station id on ties, so
+// rank 0 agrees with multi_source_bfs's origin). Memory is O(n * k).
+struct TopKStations {
+    int k = 0;
+    vector<int> dist;      // (n + 1) * k
+    vector<int> station;   // (n + 1) * k
+    vector<int> count;     // labels held by each node (<= k)
+
+    // number of held stations within max_dist edges (max_dist < 0: any distance)
+    int within(int v, int max_dist) const {
+        if (max_dist < 0) return count[v];
+        int c = 0;
+        while (c < count[v] && dist[(size_t)v * k + c] <= max_dist) ++c;
+        return c;
+    }
+};
+
+// k-label multi-source BFS. Labels (station, node) travel level by level; a
+// label is dropped at a node that already holds that station or already holds
+// k labels, which are all at least as close since levels are processed in order.
+// Each level is expanded in ascending station id so ties keep the lowest ids.
+TopKStations multi_source_topk(const CSRGraph &g, const vector<int> &stations, int k) {
+    TopKStations t;
+    t.k = k;
+    t.dist.assign((size_t)(g.n + 1) * k, -1);
+    t.station.assign((size_t)(g.n + 1) * k, 0);
+    t.count.assign(g.n + 1, 0);
+
+    vector<pair<int,int>> level_labels, next_labels; // (station, node)
+    for (int s : stations) {
+        if (s <= 0 || s > g.n || t.count[s] > 0) continue;
+        t.dist[(size_t)s * k] = 0;
+        t.station[(size_t)s * k] = s;
+        t.count[s] = 1;
+        level_labels.push_back({s, s});
+    }
+    sort(level_labels.begin(), level_labels.end());
+
+    for (int d = 1; !level_labels.empty(); ++d) {
+        next_labels.clear();
+        for (auto &lab : level_labels) {
+            int s = lab.first, u = lab.second;
+            for (int64_t e = g.offsets[u]; e < g.offsets[u + 1]; ++e) {
+                int v = g.neighbors[e];
+                int c = t.count[v];
+                if (c == k) continue;
+                size_t base = (size_t)v * k;
+                bool held = false;
+                for (int r = 0; r < c && !held; ++r) held = (t.station[base + r] == s);
+                if (held) continue;
+                t.dist[base + c] = d;
+                t.station[base + c] = s;
+                t.count[v] = c + 1;
+                next_labels.push_back({s, v});
             }
         }
+        sort(next_labels.begin(), next_labels.end());
+        level_labels.swap(next_labels);
     }
-    return {dist, origin};
+    return t;
 }
 
+// ------------------- Weighted shortest paths --------------------------------
+
+// Monotone integer priority queues: keys come out in nondecreasing order and a
+// pushed key is never smaller than the last popped one, which holds for
+// Dijkstra-style searches with positive weights. Keys are (distance << shift) | tag.
+
+// Dial's bucket queue: max_step + 1 circular buckets indexed by distance.
+// Pending distances always lie within max_step of the current one, so each
+// bucket holds a single distance; a bucket is sorted when it becomes current so
+// equal distances come out in tag order. O(1) per operation plus O(max distance).
+class BucketQueue {
+public:
+    BucketQueue(uint64_t max_step, int shift) : buckets_(max_step + 1), shift_(shift) {}
+    bool empty() const { return size_ == 0; }
+    void push(uint64_t key, int item) {
+        buckets_[(key >> shift_) % buckets_.size()].push_back({key, item});
+        ++size_;
+    }
+    pair<uint64_t,int> pop() {
+        while (pos_ == active_.size()) {
+            active_.clear();
+            pos_ = 0;
+            active_.swap(buckets_[next_ % buckets_.size()]);
+            ++next_;
+            sort(active_.begin(), active_.end());
+        }
+        --size_;
+        return active_[pos_++];
+    }
+private:
+    vector<vector<pair<uint64_t,int>>> buckets_;
+    vector<pair<uint64_t,int>> active_;   // the bucket being drained
+    size_t pos_ = 0, size_ = 0;
+    uint64_t next_ = 0;                   // next distance to load
+    int shift_;
+};
+
+// Radix heap: bucket i holds keys whose highest bit differing from the last
+// popped key is bit i-1. Popping from an empty bucket 0 redistributes the first
+// non-empty bucket, so each entry moves at most 64 times: O(log C) amortized.
+class RadixHeap {
+public:
+    bool empty() const { return size_ == 0; }
+    void push(uint64_t key, int item) {
+        buckets_[bucket_of(key)].push_back({key, item});
+        ++size_;
+    }
+    pair<uint64_t,int> pop() {
+        if (buckets_[0].empty()) {
+            size_t i = 1;
+            while (buckets_[i].empty()) ++i;
+            uint64_t mn = buckets_[i][0].first;
+            for (auto &e : buckets_[i]) mn = min(mn, e.first);
+            last_ = mn;
+            for (auto &e : buckets_[i]) buckets_[bucket_of(e.first)].push_back(e);
+            buckets_[i].clear();
+        }
+        --size_;
+        auto e = buckets_[0].back();
+        buckets_[0].pop_back();
+        return e;
+    }
+private:
+    size_t bucket_of(uint64_t key) const { return key == last_ ? 0 : 64 - __builtin_clzll(key ^ last_); }
+    array<vector<pair<uint64_t,int>>, 65> buckets_;
+    uint64_t last_ = 0;
+    size_t size_ = 0;
+};
+
+// k-label multi-source Dijkstra over the edge weights (every edge costs 1 on an
+// unweighted graph). Queue entries are keyed (distance, station rank) so equal
+// distances settle in ascending station id, like multi_source_topk; a node stops
+// accepting labels once it holds k. Each settled label scans its node's edges
+// once, so the work is O(k * m) queue operations.
+template <class Queue>
+bool weighted_topk_search(const CSRGraph &g, const vector<int> &ranked, int k, int rank_bits,
+                          Queue &q, TopKStations &t) {
+    const uint64_t rank_mask = (1ULL << rank_bits) - 1;
+    t.k = k;
+    t.dist.assign((size_t)(g.n + 1) * k, -1);
+    t.station.assign((size_t)(g.n + 1) * k, 0);
+    t.count.assign(g.n + 1, 0);
+    for (size_t r = 0; r < ranked.size(); ++r) q.push(r, ranked[r]);
+
+    while (!q.empty()) {
+        auto top = q.pop();
+        uint64_t d = top.first >> rank_bits, rank = top.first & rank_mask;
+        int v = top.second, s = ranked[rank];
+        int c = t.count[v];
+        if (c == k) continue;
+        size_t base = (size_t)v * k;
+        bool held = false;
+        for (int r = 0; r < c && !held; ++r) held = (t.station[base + r] == s);
+        if (held) continue;
+        if (d > (uint64_t)INT_MAX) return false; // does not fit the int distance columns
+        t.dist[base + c] = (int)d;
+        t.station[base + c] = s;
+        t.count[v] = c + 1;
+        for (int64_t e = g.offsets[v]; e < g.offsets[v + 1]; ++e) {
+            int w = g.neighbors[e];
+            if (t.count[w] == k) continue;
+            q.push(((d + (uint64_t)g.weight(e)) << rank_bits) | rank, w);
+        }
+    }
+    return true;
+}
+
+// Weighted k nearest stations per node. Small maximum weights use Dial's buckets,
+// larger ones the radix heap. Returns false (with err set) on distance overflow.
+bool multi_source_weighted_topk(const CSRGraph &g, const vector<int> &stations, int k,
+                                TopKStations &out, string &queue_used, string &err) {
+    const int DIAL_MAX_WEIGHT = 1024;
+    vector<int> ranked;
+    for (int s : stations) if (s > 0 && s <= g.n) ranked.push_back(s);
+    sort(ranked.begin(), ranked.end());
+    ranked.erase(unique(ranked.begin(), ranked.end()), ranked.end());
+    int rank_bits = 1;
+    while ((1ULL << rank_bits) < ranked.size()) ++rank_bits;
+    bool ok;
+    if (g.max_weight <= DIAL_MAX_WEIGHT) {
+        BucketQueue q(g.max_weight, rank_bits);
+        queue_used = "Dial buckets";
+        ok = weighted_topk_search(g, ranked, k, rank_bits, q, out);
+    } else {
+        RadixHeap q;
+        queue_used = "radix heap";
+        ok = weighted_topk_search(g, ranked, k, rank_bits, q, out);
+    }
+    if (!ok) err = "shortest-path distance exceeds " + to_string(INT_MAX);
+    return ok;
+}
+
+// ------------------- Capacitated station assignment ------------------------
+
+// Every station may serve at most `capacity` nodes. Candidate (node, station)
+// pairs come from the k nearest stations per node and are taken greedily in
+// order of (distance, station id, node): a node goes to its nearest station
+// that still has room, so a full station's excess spills to the next nearest.
+// Nodes whose k nearest stations are all full stay unserved.
+struct CapacitatedAssignment {
+    vector<int> station;   // assigned station per node, 0 if unserved
+    vector<int> dist;      // distance to it, -1 if unserved
+    vector<int> rank;      // 1 = nearest station, 2 = next nearest, ...; 0 if unserved
+    int64_t spilled = 0;   // served, but not by their nearest station
+    int64_t unserved = 0;  // reachable, but every candidate station was full
+};
+
+CapacitatedAssignment assign_with_capacity(const TopKStations &tk, int n, int capacity) {
+    CapacitatedAssignment a;
+    a.station.assign(n + 1, 0);
+    a.dist.assign(n + 1, -1);
+    a.rank.assign(n + 1, 0);
+    struct Candidate { int dist, station, node, rank; };
+    vector<Candidate> cand;
+    cand.reserve(tk.dist.size());
+    for (int v = 1; v <= n; ++v)
+        for (int r = 0; r < tk.count[v]; ++r)
+            cand.push_back({tk.dist[(size_t)v * tk.k + r], tk.station[(size_t)v * tk.k + r], v, r + 1});
+    sort(cand.begin(), cand.end(), [](const Candidate &x, const Candidate &y) {
+        if (x.dist != y.dist) return x.dist < y.dist;
+        if (x.station != y.station) return x.station < y.station;
+        return x.node < y.node;
+    });
+    unordered_map<int,int> load;
+    for (auto &c : cand) {
+        if (a.station[c.node] != 0) continue;
+        int &l = load[c.station];
+        if (l >= capacity) continue;
+        ++l;
+        a.station[c.node] = c.station;
+        a.dist[c.node] = c.dist;
+        a.rank[c.node] = c.rank;
+        if (c.rank > 1) ++a.spilled;
+    }
+    for (int v = 1; v <= n; ++v)
+        if (tk.count[v] > 0 && a.station[v] == 0) ++a.unserved;
+    return a;
+}
+
+// ------------------- Incremental station updates ---------------------------
+
+// Keeps dist/origin of a multi-source BFS up to date while stations open and
+// close, touching only the part of the graph whose answer actually changes.
+// Every node carries the label (dist, origin) and the correct label is the
+// lexicographic minimum of (dist[u] + 1, origin[u]) over its neighbors u, which
+// is exactly what multi_source_bfs computes (lowest station id on ties).
+class StationCoverage {
+public:
+    StationCoverage(const CSRGraph &g, vector<int> dist, vector<int> origin, const vector<int> &stations)
+        : g_(g), dist_(move(dist)), origin_(move(origin)),
+          is_station_(g.n + 1, 0), in_region_(g.n + 1, 0) {
+        for (int s : stations) if (s > 0 && s <= g_.n) is_station_[s] = 1;
+        for (int v = 1; v <= g_.n; ++v) {
+            if (dist_[v] < 0) continue;
+            ++reachable_;
+            total_distance_ += dist_[v];
+        }
+    }
+
+    const vector<int> &dist() const { return dist_; }
+    const vector<int> &origin() const { return origin_; }
+    bool is_station(int s) const { return s > 0 && s <= g_.n && is_station_[s]; }
+    int64_t reachable() const { return reachable_; }
+    int64_t total_distance() const { return total_distance_; } // sum over reachable nodes
+
+    // Open a station at s: BFS outward from s, but only through nodes whose
+    // label s improves; anything behind an unimproved node cannot improve either.
+    // Returns the number of nodes whose label changed; if `reached_distance` is
+    // given it receives the summed distance of nodes that were unreachable before.
+    int64_t add_station(int s, int64_t *reached_distance = nullptr) {
+        if (reached_distance) *reached_distance = 0;
+        if (s <= 0 || s > g_.n || is_station_[s]) return 0;
+        is_station_[s] = 1;
+        queue_.clear();
+        set_label(s, 0, s);
+        queue_.push_back(s);
+        for (size_t head = 0; head < queue_.size(); ++head) {
+            int u = queue_[head];
+            int d = dist_[u] + 1;
+            for (int64_t e = g_.offsets[u]; e < g_.offsets[u + 1]; ++e) {
+                int v = g_.neighbors[e];
+                if (!better(d, s, v)) continue;
+                if (reached_distance && dist_[v] < 0) *reached_distance += d;
+                set_label(v, d, s);
+                queue_.push_back(v);
+            }
+        }
+        return (int64_t)queue_.size();
+    }
+
+    // Close the station at s. The affected region is every node whose origin is s
+    // (it is connected through s). Those labels are invalidated, then repaired
+    // from the region's boundary: each region node is seeded with the best label
+    // offered by an unaffected neighbor, seeds are processed in distance order
+    // merged with a FIFO of labels propagated inside the region.
+    // Returns the number of nodes whose label changed.
+    int64_t remove_station(int s) {
+        if (s <= 0 || s > g_.n || !is_station_[s]) return 0;
+        is_station_[s] = 0;
+
+        // 1) collect the region
+        region_.clear();
+        region_.push_back(s);
+        in_region_[s] = 1;
+        for (size_t head = 0; head < region_.size(); ++head) {
+            int u = region_[head];
+            for (int64_t e = g_.offsets[u]; e < g_.offsets[u + 1]; ++e) {
+                int v = g_.neighbors[e];
+                if (!in_region_[v] && origin_[v] == s) {
+                    in_region_[v] = 1;
+                    region_.push_back(v);
+                }
+            }
+        }
+        for (int v : region_) set_label(v, -1, 0);
+
+        // 2) seed labels from unaffected neighbors
+        seeds_.clear();
+        for (int v : region_) {
+            for (int64_t e = g_.offsets[v]; e < g_.offsets[v + 1]; ++e) {
+                int u = g_.neighbors[e];
+                if (in_region_[u] || dist_[u] < 0) continue;
+                if (better(dist_[u] + 1, origin_[u], v)) set_label(v, dist_[u] + 1, origin_[u]);
+            }
+            if (dist_[v] >= 0) seeds_.push_back({dist_[v], v});
+        }
+        sort(seeds_.begin(), seeds_.end());
+
+        // 3) propagate inside the region in nondecreasing distance order; a node is
+        // expanded once, after every neighbor one level closer has been expanded
+        queue_.clear();
+        size_t seed_pos = 0, head = 0;
+        while (seed_pos < seeds_.size() || head < queue_.size()) {
+            int v;
+            if (head < queue_.size() &&
+                (seed_pos == seeds_.size() || dist_[queue_[head]] <= seeds_[seed_pos].first)) {
+                v = queue_[head++];
+            } else {
+                v = seeds_[seed_pos].second;
+                if (dist_[v] != seeds_[seed_pos++].first) continue; // stale seed
+            }
+            if (!in_region_[v]) continue; // already expanded
+            in_region_[v] = 0;
+            int d = dist_[v] + 1;
+            for (int64_t e = g_.offsets[v]; e < g_.offsets[v + 1]; ++e) {
+                int w = g_.neighbors[e];
+                if (!in_region_[w] || !better(d, origin_[v], w)) continue;
+                bool first = dist_[w] != d;
+                set_label(w, d, origin_[v]);
+                if (first) queue_.push_back(w);
+            }
+        }
+        for (int v : region_) in_region_[v] = 0; // nodes left unreachable
+        return (int64_t)region_.size();
+    }
+
+private:
+    // Would label (d, o) beat v's current label?
+    bool better(int d, int o, int v) const {
+        return dist_[v] < 0 || d < dist_[v] || (d == dist_[v] && o < origin_[v]);
+    }
+    void set_label(int v, int d, int o) {
+        if (dist_[v] >= 0) { --reachable_; total_distance_ -= dist_[v]; }
+        if (d >= 0) { ++reachable_; total_distance_ += d; }
+        dist_[v] = d;
+        origin_[v] = o;
+    }
+
+    const CSRGraph &g_;
+    vector<int> dist_, origin_;
+    vector<char> is_station_, in_region_;
+    vector<int> queue_, region_;            // scratch, reused between calls
+    vector<pair<int,int>> seeds_;           // (distance, node)
+    int64_t reachable_ = 0, total_distance_ = 0;
+};
+
 // --------------------------- Main Program ---------------------------------
 
 int main(int argc, char** argv) {
@@ -186,79 +1025,264 @@ int main(int argc, char** argv) {
 
     cout << "Multi-Source BFS (expanded implementation)\n";
     if (argc < 2) {
-        cerr << "Usage: " << argv[0] << " graph_with_stations.csv\n";
+        cerr << "Usage: " << argv[0] << " graph_with_stations.csv|graph.snap [--threads T] [--save-snapshot FILE]"
+             << " [--open NODE]... [--close NODE]... [--what-if K] [--seed S] [--topk K] [--within D]"
+             << " [--weighted] [--capacity C] [--spill-k K]\n";
         return 1;
     }
     string csv_file = argv[1];
+    int threads = (int)max(1u, thread::hardware_concurrency());
+    vector<pair<bool,int>> station_edits; // (open?, node) in command-line order
+    int what_if = 0;
+    unsigned seed = 1;
+    int topk = 0, within = -1;
+    string snapshot_out;
+    bool weighted = false;
+    int capacity = 0, spill_k = 4;
+    for (int i = 2; i < argc; ++i) {
+        string a = argv[i];
+        if (a == "--threads" && i + 1 < argc) threads = max(1, safe_stoi(argv[++i]));
+        else if (a == "--open" && i + 1 < argc) station_edits.push_back({true, safe_stoi(argv[++i])});
+        else if (a == "--close" && i + 1 < argc) station_edits.push_back({false, safe_stoi(argv[++i])});
+        else if (a == "--what-if" && i + 1 < argc) what_if = max(0, safe_stoi(argv[++i]));
+        else if (a == "--weighted") weighted = true;
+        else if (a == "--capacity" && i + 1 < argc) capacity = max(0, safe_stoi(argv[++i]));
+        else if (a == "--spill-k" && i + 1 < argc) spill_k = min(64, max(1, safe_stoi(argv[++i])));
+        else if (a == "--save-snapshot" && i + 1 < argc) snapshot_out = argv[++i];
+        else if (a == "--topk" && i + 1 < argc) topk = min(64, max(0, safe_stoi(argv[++i])));
+        else if (a == "--within" && i + 1 < argc) within = safe_stoi(argv[++i]);
+        else if (a == "--seed" && i + 1 < argc) seed = (unsigned)max(0, safe_stoi(argv[++i]));
+        else cerr << "Warning: unknown argument '" << a << "' ignored.\n";
+    }
 
-    // 1) Read CSV and build GraphData
+    // 1) Load the graph: map a binary snapshot, or read CSV and build GraphData
     GraphData gd;
+    CSRGraph g;
     string err;
-    cout << "Reading CSV '" << csv_file << "' ...\n";
-    if (!read_graph_csv(csv_file, gd, err)) {
-        cerr << "Error reading CSV: " << err << "\n";
-        return 1;
+    int N = 0;
+    if (is_snapshot_file(csv_file)) {
+        auto t_load = chrono::steady_clock::now();
+        if (!load_snapshot(csv_file, g, gd.stations, err)) {
+            cerr << "Error loading snapshot: " << err << "\n";
+            return 1;
+        }
+        N = g.n;
+        double load_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t_load).count();
+        cout << "Mapped snapshot '" << csv_file << "' in " << load_ms << " ms: nodes 1.." << N
+             << ", undirected edges = " << g.num_arcs / 2 << ", stations = " << gd.stations.size() << "\n";
+    } else {
+        cout << "Reading CSV '" << csv_file << "' ...\n";
+        if (!read_graph_csv(csv_file, gd, err)) {
+            cerr << "Error reading CSV: " << err << "\n";
+            return 1;
+        }
+
+        if (gd.max_node <= 0) {
+            cerr << "No nodes found in input CSV. Exiting.\n";
+            return 1;
+        }
+
+        cout << "Parsed graph: max_node = " << gd.max_node
+             << ", edges = " << gd.edges.size()
+             << ", station rows = " << gd.stations.size() << "\n";
+
+        // Remove duplicate stations while preserving order
+        {
+            sort(gd.stations.begin(), gd.stations.end());
+            gd.stations.erase(unique(gd.stations.begin(), gd.stations.end()), gd.stations.end());
+            // If you want to preserve original order instead of sort/unique:
+            // use an ordered set or boolean visited array to filter duplicates.
+        }
+        cout << "Unique stations count = " << gd.stations.size() << "\n";
+
+        // 2) Build CSR adjacency (undirected, duplicates and self-loops removed).
+        // Stations are already covered by max_node, so isolated stations get an empty row.
+        N = gd.max_node;
+        auto t_build = chrono::steady_clock::now();
+        g = build_csr(N, gd.edges, gd.weighted ? gd.weights : vector<int>());
+        double build_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t_build).count();
+        cout << "CSR built in " << build_ms << " ms. Effective nodes: 1.." << N
+             << ", undirected edges = " << g.num_arcs / 2
+             << (g.weights ? ", weighted (max weight " + to_string(g.max_weight) + ")" : string()) << ".\n";
+        vector<pair<int,int>>().swap(gd.edges); // raw edge list no longer needed
+        vector<int>().swap(gd.weights);
+
+        if (!snapshot_out.empty()) {
+            auto t_snap = chrono::steady_clock::now();
+            if (!write_snapshot(snapshot_out, g, gd.stations, err)) {
+                cerr << "Error writing snapshot: " << err << "\n";
+                return 1;
+            }
+            double snap_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t_snap).count();
+            cout << "Wrote snapshot '" << snapshot_out << "' in " << snap_ms << " ms.\n";
+        }
     }
 
-    if (gd.max_node <= 0) {
-        cerr << "No nodes found in input CSV. Exiting.\n";
-        return 1;
+    if (weighted && !g.weights) cout << "Note: graph has no edge weights; every edge costs 1.\n";
+    if (weighted && (!station_edits.empty() || what_if > 0)) {
+        cerr << "Warning: --open/--close/--what-if work on hop distances and are ignored with --weighted.\n";
+        station_edits.clear();
+        what_if = 0;
     }
 
-    cout << "Parsed graph: max_node = " << gd.max_node
-         << ", edges = " << gd.edges.size()
-         << ", station rows = " << gd.stations.size() << "\n";
+    // 3) Run multi-source BFS (or weighted shortest paths)
+    vector<int> dist, origin;
+    if (weighted) {
+        cout << "Starting weighted multi-source shortest paths from " << gd.stations.size() << " stations ...\n";
+        TopKStations nearest;
+        string queue_used;
+        auto t_sp = chrono::steady_clock::now();
+        if (!multi_source_weighted_topk(g, gd.stations, 1, nearest, queue_used, err)) {
+            cerr << "Error: " << err << "\n";
+            return 1;
+        }
+        double sp_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t_sp).count();
+        cout << "Weighted search done in " << sp_ms << " ms using " << queue_used << ".\n";
+        dist.assign(N + 1, -1);
+        origin.assign(N + 1, 0);
+        for (int v = 1; v <= N; ++v) {
+            if (nearest.count[v] == 0) continue;
+            dist[v] = nearest.dist[v];
+            origin[v] = nearest.station[v];
+        }
+    } else {
+        cout << "Starting multi-source BFS from " << gd.stations.size() << " stations on "
+             << threads << " thread(s) ...\n";
+        BFSStats bfs_stats;
+        auto t_bfs = chrono::steady_clock::now();
+        multi_source_bfs(g, gd.stations, threads, dist, origin, &bfs_stats);
+        double bfs_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t_bfs).count();
+        cout << "BFS done in " << bfs_ms << " ms: " << bfs_stats.levels << " levels ("
+             << bfs_stats.bottom_up_levels << " bottom-up), "
+             << bfs_stats.edges_scanned / max(1e-3, bfs_ms) / 1000.0 << " M edges scanned/s.\n";
+    }
 
-    // Remove duplicate stations while preserving order
-    {
-        sort(gd.stations.begin(), gd.stations.end());
-        gd.stations.erase(unique(gd.stations.begin(), gd.stations.end()), gd.stations.end());
-        // If you want to preserve original order instead of sort/unique:
-        // use an ordered set or boolean visited array to filter duplicates.
-    }
-    cout << "Unique stations count = " << gd.stations.size() << "\n";
-
-    // 2) Build adjacency list
-    int N = gd.max_node;
-    vector<vector<int>> adj(N + 1);
-    // Reserve some space heuristically: average degree ~ 4 maybe
-    for (int i = 1; i <= N; ++i) adj[i].reserve(4);
-
-    // Add edges (undirected), avoid duplicating exact pairs (u,v) and self-loops
-    // We'll track seen edges with unordered_set of 64-bit keys: key = ((uint64)min<<32) | max
-    unordered_set<uint64_t> seen_edges;
-    seen_edges.reserve(gd.edges.size() * 2 + 10);
-
-    for (auto &e : gd.edges) {
-        int u = e.first, v = e.second;
-        if (u <= 0 || v <= 0 || u > N || v > N) continue;
-        if (u == v) continue;
-        int a = min(u,v), b = max(u,v);
-        uint64_t key = ( (uint64_t)a << 32 ) | (uint64_t)b;
-        if (seen_edges.find(key) != seen_edges.end()) continue; // duplicate
-        seen_edges.insert(key);
-        adj[u].push_back(v);
-        adj[v].push_back(u);
-    }
-
-    // 3) Ensure stations exist as nodes even if isolated (adj list exists)
-    for (int s : gd.stations) {
-        if (s > N) {
-            // enlarge adjacency (shouldn't normally happen because max_node tracked)
-            adj.resize(s + 1);
-            N = s;
+    // 3b) Incremental station changes and what-if scoring
+    if (!station_edits.empty() || what_if > 0) {
+        StationCoverage cov(g, move(dist), move(origin), gd.stations);
+        for (auto &ed : station_edits) {
+            int node = ed.second;
+            if (node <= 0 || node > N) {
+                cerr << "Warning: node " << node << " out of range, edit skipped.\n";
+                continue;
+            }
+            int64_t changed = ed.first ? cov.add_station(node) : cov.remove_station(node);
+            cout << (ed.first ? "Opened" : "Closed") << " station " << node << ": "
+                 << changed << " nodes updated.\n";
+        }
+
+        if (what_if > 0) {
+            // Candidate sites: random non-station nodes. Each is opened, scored and closed again.
+            mt19937 rng(seed);
+            struct WhatIf { int node; int64_t changed, saved, newly_reachable; };
+            vector<WhatIf> results;
+            int64_t base_total = cov.total_distance(), base_reach = cov.reachable();
+            vector<char> drawn(N + 1, 0);
+            auto t0 = chrono::steady_clock::now();
+            for (int k = 0; k < what_if; ++k) {
+                int node = (int)(rng() % N) + 1;
+                if (cov.is_station(node) || drawn[node]) continue;
+                drawn[node] = 1;
+                WhatIf w;
+                w.node = node;
+                int64_t reached_distance;
+                w.changed = cov.add_station(node, &reached_distance);
+                w.newly_reachable = cov.reachable() - base_reach;
+                // newly reached nodes add distance, so only compare previously reachable ones
+                w.saved = base_total - (cov.total_distance() - reached_distance);
+                cov.remove_station(node);
+                results.push_back(w);
+            }
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+            cout << "What-if: " << results.size() << " candidate sites in " << ms << " ms ("
+                 << results.size() / max(1e-6, ms / 1000.0) << " placements/s).\n";
+            sort(results.begin(), results.end(), [](const WhatIf &a, const WhatIf &b) {
+                if (a.newly_reachable != b.newly_reachable) return a.newly_reachable > b.newly_reachable;
+                return a.saved > b.saved;
+            });
+            ofstream fw("what_if.csv");
+            fw << "node_id,nodes_improved,distance_saved,newly_reachable\n";
+            for (auto &w : results) fw << w.node << "," << w.changed << "," << w.saved << "," << w.newly_reachable << "\n";
+            for (size_t k = 0; k < min<size_t>(5, results.size()); ++k)
+                cout << "  site " << results[k].node << ": " << results[k].changed << " nodes improved, total distance -"
+                     << results[k].saved << ", newly reachable " << results[k].newly_reachable << "\n";
+            cout << "Wrote what-if ranking to 'what_if.csv'.\n";
         }
+        dist = cov.dist();
+        origin = cov.origin();
     }
 
-    cout << "Adjacency built. Effective nodes: 1.." << N << ".\n";
+    // k nearest stations per node under the active metric (hops or weights),
+    // from the stations left after any --open/--close edits.
+    vector<int> current_stations;
+    if (topk > 0 || capacity > 0)
+        for (int v = 1; v <= N; ++v) if (dist[v] == 0) current_stations.push_back(v);
+    auto nearest_k = [&](int k, TopKStations &tk) {
+        string queue_used;
+        if (!weighted) tk = multi_source_topk(g, current_stations, k);
+        else return multi_source_weighted_topk(g, current_stations, k, tk, queue_used, err);
+        return true;
+    };
+
+    // 3c) Top-k nearest stations (redundant coverage)
+    if (topk > 0) {
+        auto t0 = chrono::steady_clock::now();
+        TopKStations tk;
+        if (!nearest_k(topk, tk)) {
+            cerr << "Error: " << err << "\n";
+            return 1;
+        }
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+        cout << "Top-" << topk << " stations per node computed in " << ms << " ms ("
+             << (tk.dist.size() * 2 * sizeof(int) + tk.count.size() * sizeof(int)) / 1048576.0 << " MB).\n";
+
+        ofstream ft("topk_stations.csv");
+        ft << "node_id,rank,station_id,distance\n";
+        for (int v = 1; v <= N; ++v)
+            for (int r = 0; r < tk.count[v]; ++r)
+                ft << v << "," << r + 1 << "," << tk.station[(size_t)v * topk + r] << ","
+                   << tk.dist[(size_t)v * topk + r] << "\n";
+        ft.close();
 
-    // 4) Run multi-source BFS
-    cout << "Starting multi-source BFS from " << gd.stations.size() << " stations ...\n";
-    auto result = multi_source_bfs(adj, gd.stations);
-    vector<int> dist = move(result.first);
-    vector<int> origin = move(result.second);
+        ofstream fu("undercovered_nodes.csv");
+        fu << "node_id,stations_within\n";
+        int under = 0;
+        for (int v = 1; v <= N; ++v) {
+            int c = tk.within(v, within);
+            if (c >= topk) continue;
+            ++under;
+            fu << v << "," << c << "\n";
+        }
+        fu.close();
+        cout << under << " nodes have fewer than " << topk << " stations within "
+             << (within < 0 ? string("any distance") : to_string(within) + (weighted ? "" : " edges"))
+             << "; wrote 'topk_stations.csv' and 'undercovered_nodes.csv'.\n";
+    }
+
+    // 3d) Capacitated assignment: stations serve at most `capacity` nodes each
+    CapacitatedAssignment assigned;
+    if (capacity > 0) {
+        auto t0 = chrono::steady_clock::now();
+        TopKStations tk;
+        if (!nearest_k(spill_k, tk)) {
+            cerr << "Error: " << err << "\n";
+            return 1;
+        }
+        assigned = assign_with_capacity(tk, N, capacity);
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+        cout << "Capacitated assignment (capacity " << capacity << ", " << spill_k
+             << " candidate stations per node) done in " << ms << " ms: " << assigned.spilled
+             << " nodes spilled past their nearest station, " << assigned.unserved << " unserved.\n";
+
+        ofstream fc("capacitated_assignment.csv");
+        fc << "node_id,station_id,distance,rank\n";
+        for (int v = 1; v <= N; ++v)
+            fc << v << "," << assigned.station[v] << "," << assigned.dist[v] << "," << assigned.rank[v] << "\n";
+        fc.close();
+        cout << "Wrote 'capacitated_assignment.csv'.\n";
+    }
 
-    // 5) Basic statistics
+    // 4) Basic statistics
     int reachable = 0;
     int unreachable = 0;
     int max_dist = -1;
@@ -272,7 +1296,7 @@ int main(int argc, char** argv) {
                 max_dist = d;
                 farthest_node = node;
             }
-            int st = origin[node];
+            int st = capacity > 0 ? assigned.station[node] : origin[node];
             if (st > 0) ++count_by_station[st];
         } else {
             ++unreachable;
@@ -281,12 +1305,13 @@ int main(int argc, char** argv) {
 
     cout << "Reachable nodes = " << reachable << ", unreachable = " << unreachable << "\n";
     if (max_dist >= 0) {
-        cout << "Farthest node from any station: node " << farthest_node << " at distance " << max_dist << " edges.\n";
+        cout << "Farthest node from any station: node " << farthest_node << " at distance " << max_dist
+             << (weighted ? ".\n" : " edges.\n");
     } else {
         cout << "No node reached (no stations or empty graph).\n";
     }
 
-    // 6) Write distances CSV
+    // 5) Write distances CSV
     string out_csv = "distances.csv";
     cout << "Writing distances to '" << out_csv << "' ...\n";
     ofstream fout(out_csv);
@@ -301,7 +1326,7 @@ int main(int argc, char** argv) {
     fout.close();
     cout << "Wrote " << N << " rows to '" << out_csv << "'.\n";
 
-    // 7) Optional: write per-station coverage summary
+    // 6) Optional: write per-station coverage summary
     string summary_csv = "station_coverage.csv";
     cout << "Writing per-station coverage to '" << summary_csv << "' ...\n";
     ofstream fs(summary_csv);
@@ -1,6 +1,6 @@
 // knn_location_risk.cpp
 // K-Nearest Neighbors for classifying a location as Safe or Risky
-// Compile: g++ -std=c++17 -O2 -o knn_location_risk knn_location_risk.cpp
+// Compile: g++ -std=c++17 -O2 -pthread -o knn_location_risk knn_location_risk.cpp
 //
 // The program reads a CSV of historical reports with columns:
 // report_id,latitude,longitude,label,severity,timestamp
@@ -13,6 +13,13 @@
 // Author: generated by ChatGPT
 
 #include <bits/stdc++.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 using namespace std;
 
 // --------------------------- Utilities ------------------------------------
@@ -57,6 +64,16 @@ double haversine_distance_m(double lat1, double lon1, double lat2, double lon2)
     return R * c;
 }
 
+// Unit vector on the sphere. The squared chord between two of them grows
+// monotonically with great-circle distance, so nearest-neighbor searches can
+// rank by plain Euclidean distance and leave the trig to the winners.
+struct UnitVec { double x, y, z; };
+
+UnitVec to_unit_sphere(double lat, double lon) {
+    double la = deg2rad(lat), lo = deg2rad(lon);
+    return {cos(la) * cos(lo), cos(la) * sin(lo), sin(la)};
+}
+
 // --------------------------- Data Structures -------------------------------
 
 struct Point {
@@ -72,33 +89,209 @@ struct Neighbor {
     double dist; // in meters
     int label;
     string id;
+    int severity = 1;
+    long timestamp = 0;
     bool operator<(const Neighbor &o) const {
         return dist < o.dist;
     }
 };
 
 // --------------------------- Brute-force KNN -------------------------------
+// Scans unit-sphere coordinates kept in 64-byte aligned structure-of-arrays
+// form. An AVX-512 or AVX2 kernel (picked at runtime, scalar fallback otherwise)
+// computes squared chord distances for a block of points and compares them with
+// the current K-th best in one vector test, so a block only branches into the
+// top-K heap when one of its points qualifies. Labels and ids are read for the
+// K winners only.
+
+template <class T>
+struct AlignedAllocator {
+    using value_type = T;
+    AlignedAllocator() = default;
+    template <class U> AlignedAllocator(const AlignedAllocator<U> &) {}
+    T* allocate(size_t n) {
+        void *p = ::operator new(max<size_t>(1, n) * sizeof(T), align_val_t(64));
+        return static_cast<T*>(p);
+    }
+    void deallocate(T *p, size_t) { ::operator delete(p, align_val_t(64)); }
+    template <class U> bool operator==(const AlignedAllocator<U> &) const { return true; }
+    template <class U> bool operator!=(const AlignedAllocator<U> &) const { return false; }
+};
+using AlignedDoubles = vector<double, AlignedAllocator<double>>;
+
+// Fixed-capacity max-heap of (squared chord, index) keeping the K smallest.
+// offer() makes no calls so it inlines into the SIMD kernels; calling out of
+// AVX code into SSE code costs a state transition per admitted point.
+struct TopK {
+    int K = 0, size = 0;
+    vector<pair<double,int>> heap;
+    double worst = numeric_limits<double>::infinity(); // admission threshold
 
-// Return K nearest neighbors (unsorted or sorted) using nth_element for speed.
-vector<Neighbor> knn_bruteforce(const vector<Point> &data, double qlat, double qlon, int K) {
-    int N = (int)data.size();
-    vector<Neighbor> arr;
-    arr.reserve(N);
-    for (const auto &p : data) {
-        double d = haversine_distance_m(qlat, qlon, p.lat, p.lon);
-        arr.push_back({d, p.label, p.id});
-    }
-    if (K >= N) {
-        sort(arr.begin(), arr.end(), [](const Neighbor &a, const Neighbor &b){ return a.dist < b.dist; });
-        return arr;
-    }
-    // Use nth_element to get K smallest in O(N)
-    nth_element(arr.begin(), arr.begin() + K, arr.end(), [](const Neighbor &a, const Neighbor &b){ return a.dist < b.dist; });
-    arr.resize(K);
-    sort(arr.begin(), arr.end(), [](const Neighbor &a, const Neighbor &b){ return a.dist < b.dist; });
-    return arr;
+    explicit TopK(int k) : K(k), heap(k) {}
+    void reset() { size = 0; worst = numeric_limits<double>::infinity(); }
+    inline void offer(double d2, int i) {
+        if (d2 >= worst) return;
+        pair<double,int> *h = heap.data();
+        size_t pos;
+        if (size < K) {
+            pos = size++;
+            while (pos > 0 && h[(pos - 1) / 2].first < d2) {    // sift up
+                h[pos] = h[(pos - 1) / 2];
+                pos = (pos - 1) / 2;
+            }
+            h[pos] = {d2, i};
+            if (size == K) worst = h[0].first;
+            return;
+        }
+        pos = 0;                                                 // replace the root, sift down
+        while (true) {
+            size_t c = 2 * pos + 1;
+            if (c >= (size_t)K) break;
+            if (c + 1 < (size_t)K && h[c + 1].first > h[c].first) ++c;
+            if (h[c].first <= d2) break;
+            h[pos] = h[c];
+            pos = c;
+        }
+        h[pos] = {d2, i};
+        worst = h[0].first;
+    }
+};
+
+typedef void (*ChordScanFn)(const double*, const double*, const double*, size_t, const UnitVec&, TopK&);
+
+// Portable kernel; n is a multiple of 8.
+void chord_scan_scalar(const double *X, const double *Y, const double *Z, size_t n,
+                       const UnitVec &q, TopK &top) {
+    double d2[8];
+    for (size_t i = 0; i < n; i += 8) {
+        bool any = false;
+        for (int t = 0; t < 8; ++t) {
+            double dx = X[i + t] - q.x, dy = Y[i + t] - q.y, dz = Z[i + t] - q.z;
+            d2[t] = dx * dx + dy * dy + dz * dz;
+            any |= d2[t] < top.worst;
+        }
+        if (!any) continue;
+        for (int t = 0; t < 8; ++t) top.offer(d2[t], (int)(i + t));
+    }
 }
 
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+void chord_scan_avx2(const double *X, const double *Y, const double *Z, size_t n,
+                     const UnitVec &q, TopK &top) {
+    const __m256d qx = _mm256_set1_pd(q.x), qy = _mm256_set1_pd(q.y), qz = _mm256_set1_pd(q.z);
+    alignas(32) double d2[4];
+    __m256d worst = _mm256_set1_pd(top.worst);
+    for (size_t i = 0; i < n; i += 4) {
+        __m256d dx = _mm256_sub_pd(_mm256_load_pd(X + i), qx);
+        __m256d dy = _mm256_sub_pd(_mm256_load_pd(Y + i), qy);
+        __m256d dz = _mm256_sub_pd(_mm256_load_pd(Z + i), qz);
+        __m256d d = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)),
+                                  _mm256_mul_pd(dz, dz));
+        int mask = _mm256_movemask_pd(_mm256_cmp_pd(d, worst, _CMP_LT_OQ));
+        if (!mask) continue;
+        _mm256_store_pd(d2, d);
+        for (; mask; mask &= mask - 1) {
+            int t = __builtin_ctz(mask);
+            top.offer(d2[t], (int)(i + t));
+        }
+        worst = _mm256_set1_pd(top.worst);
+    }
+}
+
+__attribute__((target("avx512f")))
+void chord_scan_avx512(const double *X, const double *Y, const double *Z, size_t n,
+                       const UnitVec &q, TopK &top) {
+    const __m512d qx = _mm512_set1_pd(q.x), qy = _mm512_set1_pd(q.y), qz = _mm512_set1_pd(q.z);
+    alignas(64) double d2[8];
+    __m512d worst = _mm512_set1_pd(top.worst);
+    for (size_t i = 0; i < n; i += 8) {
+        __m512d dx = _mm512_sub_pd(_mm512_load_pd(X + i), qx);
+        __m512d dy = _mm512_sub_pd(_mm512_load_pd(Y + i), qy);
+        __m512d dz = _mm512_sub_pd(_mm512_load_pd(Z + i), qz);
+        __m512d d = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(dx, dx), _mm512_mul_pd(dy, dy)),
+                                  _mm512_mul_pd(dz, dz));
+        unsigned mask = _mm512_cmp_pd_mask(d, worst, _CMP_LT_OQ);
+        if (!mask) continue;
+        _mm512_store_pd(d2, d);
+        for (; mask; mask &= mask - 1) {
+            int t = __builtin_ctz(mask);
+            top.offer(d2[t], (int)(i + t));
+        }
+        worst = _mm512_set1_pd(top.worst);
+    }
+}
+#endif
+
+// Widest kernel the CPU supports; `name` reports which one.
+ChordScanFn pick_chord_scan(const char **name) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) { *name = "avx512"; return chord_scan_avx512; }
+    if (__builtin_cpu_supports("avx2")) { *name = "avx2"; return chord_scan_avx2; }
+#endif
+    *name = "scalar";
+    return chord_scan_scalar;
+}
+
+struct BruteForceIndex {
+    const vector<Point> *data = nullptr;
+    AlignedDoubles xs, ys, zs;      // padded to a multiple of 8 with far-away points
+    ChordScanFn scan = nullptr;
+    const char *kernel = "";
+
+    void build(const vector<Point> &pts) {
+        data = &pts;
+        size_t n = pts.size(), padded = (n + 7) / 8 * 8;
+        xs.assign(padded, 1e9);
+        ys.assign(padded, 1e9);
+        zs.assign(padded, 1e9);
+        for (size_t i = 0; i < n; ++i) {
+            UnitVec u = to_unit_sphere(pts[i].lat, pts[i].lon);
+            xs[i] = u.x; ys[i] = u.y; zs[i] = u.z;
+        }
+        scan = pick_chord_scan(&kernel);
+    }
+
+    vector<Neighbor> knn_query(double qlat, double qlon, int K) const {
+        vector<Neighbor> result;
+        if (!data || data->empty() || K <= 0) return result;
+        const int k = (int)min<size_t>(K, data->size());
+        const UnitVec q = to_unit_sphere(qlat, qlon);
+        TopK top(k);
+        // For large K most of the scan time goes to heap updates while the
+        // threshold is still loose. Seed it with a conservative quantile taken
+        // from a strided sample. Only points under the seed are admitted, so
+        // if fewer than K pass, the scan reruns unseeded.
+        const size_t n = data->size(), S = min<size_t>(n, 4096);
+        if ((double)k * S / n >= 16 && k < (int)n) {
+            vector<double> sample(S);
+            for (size_t j = 0; j < S; ++j) {
+                size_t i = j * n / S;
+                double dx = xs[i] - q.x, dy = ys[i] - q.y, dz = zs[i] - q.z;
+                sample[j] = dx * dx + dy * dy + dz * dz;
+            }
+            double expect = (double)k * S / n;
+            size_t r = (size_t)(1.25 * expect + 4.0 * sqrt(expect));
+            if (r < S) {
+                nth_element(sample.begin(), sample.begin() + r, sample.end());
+                top.worst = sample[r];
+                scan(xs.data(), ys.data(), zs.data(), xs.size(), q, top);
+                if (top.size < k) top = TopK(k);
+            }
+        }
+        if (top.size < k) scan(xs.data(), ys.data(), zs.data(), xs.size(), q, top);
+        result.reserve(top.size);
+        for (int j = 0; j < top.size; ++j) {
+            const Point &p = (*data)[top.heap[j].second];
+            result.push_back({haversine_distance_m(qlat, qlon, p.lat, p.lon), p.label, p.id,
+                              p.severity, p.timestamp});
+        }
+        sort(result.begin(), result.end());
+        return result;
+    }
+};
+
 // Weighted voting using inverse distance (with epsilon)
 double weighted_vote(const vector<Neighbor> &neighbors, double eps = 1e-6) {
     double sum_w_risky = 0.0;
@@ -112,109 +305,534 @@ double weighted_vote(const vector<Neighbor> &neighbors, double eps = 1e-6) {
     return sum_w_risky / sum_w_total; // proportion weighted
 }
 
-// Simple majority vote
-int majority_vote(const vector<Neighbor> &neighbors) {
+// Recency-weighted vote weight: halves every `half_life` seconds of age before
+// `now` (no decay when half_life <= 0), is multiplied by the report's severity
+// when requested, and by inverse distance unless voting is plain.
+double vote_weight(const Neighbor &n, long now, double half_life, bool by_severity,
+                   bool inverse_distance, double eps = 1e-6) {
+    double w = inverse_distance ? 1.0 / (n.dist + eps) : 1.0;
+    if (half_life > 0) w *= exp2(-max(0.0, (double)(now - n.timestamp)) / half_life);
+    if (by_severity) w *= max(0, n.severity);
+    return w;
+}
+
+double decayed_vote(const vector<Neighbor> &neighbors, long now, double half_life,
+                    bool by_severity, bool inverse_distance, double eps = 1e-6) {
+    double sum_w_risky = 0.0;
+    double sum_w_total = 0.0;
+    for (const auto &n : neighbors) {
+        double w = vote_weight(n, now, half_life, by_severity, inverse_distance, eps);
+        sum_w_total += w;
+        if (n.label == 1) sum_w_risky += w;
+    }
+    if (sum_w_total <= 0) return 0.0;
+    return sum_w_risky / sum_w_total;
+}
+
+// Simple majority vote, as the share of risky neighbors (tie -> 0.5 -> risky)
+double majority_vote(const vector<Neighbor> &neighbors) {
     int cntRisk = 0;
     for (const auto &n : neighbors) if (n.label == 1) ++cntRisk;
-    return (cntRisk * 2 >= (int)neighbors.size()) ? 1 : 0; // tie -> risky
+    return neighbors.empty() ? 0.0 : (double)cntRisk / neighbors.size();
 }
 
-// --------------------------- KD-Tree (2D) ---------------------------------
-// Simple KD-tree implementation for 2D points (latitude, longitude).
-// This is a recursive median-splitting KD-tree; supports KNN search.
-// Note: For production use, prefer a well-tested library (nanoflann, FLANN, etc.).
-
-struct KDNode {
-    int idx; // index in original data vector
-    int axis; // 0 = lat, 1 = lon
-    KDNode *left;
-    KDNode *right;
-    KDNode(int i= -1, int a=0): idx(i), axis(a), left(nullptr), right(nullptr) {}
-};
+// --------------------------- KD-Tree (3D, flat) ----------------------------
+// Points are mapped to unit vectors on the sphere. Straight-line (chord) distance
+// between unit vectors grows monotonically with great-circle distance, so a plain
+// Euclidean k-d tree over (x, y, z) finds the same neighbors as haversine with no
+// trig in the search loop, and its box bounds are exact (the old lat/lon tree
+// pruned with a flat 111 km-per-degree estimate).
+//
+// The tree is implicit: node i has children 2i+1 and 2i+2, all leaves sit at the
+// same depth and each holds a bucket of at most LEAF_SIZE points. Points are
+// permuted so every bucket is a contiguous run of the structure-of-arrays
+// coordinates, which a leaf scan reads in blocks of LANES doubles. Haversine
+// runs only on the K winners.
 
 struct KDTree {
-    const vector<Point> *data;
-    KDNode *root;
-    KDTree(): data(nullptr), root(nullptr) {}
-    ~KDTree() { clear(root); }
-    void clear(KDNode *node) {
-        if (!node) return;
-        clear(node->left);
-        clear(node->right);
-        delete node;
-    }
-
-    // Build indices list and recursively build
-    KDNode* build_recursive(vector<int> &idxs, int l, int r, int depth) {
-        if (l >= r) return nullptr;
-        int axis = depth % 2;
-        int m = (l + r) / 2;
-        auto comparator = [&](int a, int b) {
-            if (axis == 0) return data->at(a).lat < data->at(b).lat;
-            return data->at(a).lon < data->at(b).lon;
-        };
-        nth_element(idxs.begin()+l, idxs.begin()+m, idxs.begin()+r, comparator);
-        KDNode *node = new KDNode(idxs[m], axis);
-        node->left = build_recursive(idxs, l, m, depth+1);
-        node->right = build_recursive(idxs, m+1, r, depth+1);
-        return node;
-    }
+    static const int LEAF_SIZE = 32;
+    static const int LANES = 4;         // leaf scans work in blocks of 4 doubles
+
+    const vector<Point> *data = nullptr;
+    int levels = 0;                     // depth of the leaves
+    vector<int> order;                  // slot -> index into *data
+    vector<double> xs, ys, zs;          // coordinates by slot, padded by LANES - 1
+    vector<int> leaf_begin;             // leaf j covers slots [leaf_begin[j], leaf_begin[j+1])
+    vector<array<double,6>> box;        // per node: min x, y, z, then max x, y, z
+    vector<long> ts;                    // report timestamp by slot
+    vector<long> newest;                // per node: latest timestamp below it
 
     void build(const vector<Point> &pts) {
         data = &pts;
         int n = (int)pts.size();
-        vector<int> idxs(n);
-        iota(idxs.begin(), idxs.end(), 0);
-        root = build_recursive(idxs, 0, n, 0);
-    }
-
-    // KNN search using max-heap of size K for best neighbors
-    void knn_search(const KDNode *node, double qlat, double qlon, int K, priority_queue<pair<double,int>> &maxheap) const {
-        if (!node) return;
-        const Point &p = data->at(node->idx);
-        double d = haversine_distance_m(qlat, qlon, p.lat, p.lon);
-        if ((int)maxheap.size() < K) {
-            maxheap.push({d, node->idx});
-        } else if (d < maxheap.top().first) {
-            maxheap.pop();
-            maxheap.push({d, node->idx});
-        }
-        int axis = node->axis;
-        double diff = (axis == 0) ? (qlat - p.lat) : (qlon - p.lon);
-        const KDNode *first = diff < 0 ? node->left : node->right;
-        const KDNode *second = diff < 0 ? node->right : node->left;
-        if (first) knn_search(first, qlat, qlon, K, maxheap);
-        // Check if we need to visit other side
-        double diffMeters;
-        if (axis == 0) {
-            // Convert degrees latitude difference to meters approx using 111km per degree
-            diffMeters = fabs(diff) * 111000.0;
-        } else {
-            // longitude degree meters depends on latitude
-            double latRad = deg2rad(qlat);
-            double metersPerDegLon = 111000.0 * cos(latRad);
-            diffMeters = fabs(diff) * metersPerDegLon;
+        levels = 0;
+        while (((int64_t)LEAF_SIZE << levels) < n) ++levels;
+        box.assign((size_t(2) << levels) - 1, {});
+        newest.assign(box.size(), LONG_MIN);
+        leaf_begin.assign((size_t(1) << levels) + 1, n);
+        order.resize(n);
+        iota(order.begin(), order.end(), 0);
+
+        vector<UnitVec> u(n);
+        for (int i = 0; i < n; ++i) u[i] = to_unit_sphere(pts[i].lat, pts[i].lon);
+        if (n > 0) build_node(u, 0, 0, n, 0);
+
+        // Padding slots sit far outside the unit sphere so a block scan that runs
+        // past the last real point never produces a candidate.
+        xs.assign(n + LANES - 1, 1e9);
+        ys.assign(n + LANES - 1, 1e9);
+        zs.assign(n + LANES - 1, 1e9);
+        ts.resize(n);
+        for (int s = 0; s < n; ++s) {
+            xs[s] = u[order[s]].x;
+            ys[s] = u[order[s]].y;
+            zs[s] = u[order[s]].z;
+            ts[s] = pts[order[s]].timestamp;
+        }
+    }
+
+    // Splits slots [l, r) at the median of the box's widest axis.
+    void build_node(const vector<UnitVec> &u, size_t node, int l, int r, int depth) {
+        array<double,6> &b = box[node];
+        b = {1e9, 1e9, 1e9, -1e9, -1e9, -1e9};
+        for (int s = l; s < r; ++s) {
+            const UnitVec &p = u[order[s]];
+            b[0] = min(b[0], p.x); b[1] = min(b[1], p.y); b[2] = min(b[2], p.z);
+            b[3] = max(b[3], p.x); b[4] = max(b[4], p.y); b[5] = max(b[5], p.z);
+            newest[node] = max(newest[node], (*data)[order[s]].timestamp);
         }
-        if ((int)maxheap.size() < K || diffMeters < maxheap.top().first) {
-            if (second) knn_search(second, qlat, qlon, K, maxheap);
+        if (depth == levels) {
+            leaf_begin[node - ((size_t(1) << levels) - 1)] = l;
+            return;
         }
+        int axis = 0;
+        for (int a = 1; a < 3; ++a)
+            if (b[3 + a] - b[a] > b[3 + axis] - b[axis]) axis = a;
+        auto coord = [&](int i) { return axis == 0 ? u[i].x : axis == 1 ? u[i].y : u[i].z; };
+        int m = l + (r - l) / 2;
+        nth_element(order.begin() + l, order.begin() + m, order.begin() + r,
+                    [&](int a, int c) { return coord(a) < coord(c); });
+        build_node(u, 2 * node + 1, l, m, depth + 1);
+        build_node(u, 2 * node + 2, m, r, depth + 1);
     }
 
-    vector<Neighbor> knn_query(double qlat, double qlon, int K) const {
+    // Squared distance from q to the node's bounding box (0 inside it).
+    double box_dist2(size_t node, const UnitVec &q) const {
+        const array<double,6> &b = box[node];
+        double dx = max(0.0, max(b[0] - q.x, q.x - b[3]));
+        double dy = max(0.0, max(b[1] - q.y, q.y - b[4]));
+        double dz = max(0.0, max(b[2] - q.z, q.z - b[5]));
+        return dx * dx + dy * dy + dz * dz;
+    }
+
+    // Best-first descent with an explicit stack; `top` collects the K nearest
+    // (squared chord distance, id_base + slot) pairs. Reports older than min_ts
+    // are skipped, and so are whole subtrees whose newest report is.
+    void knn_search(const UnitVec &q, TopK &top, long min_ts = LONG_MIN, int id_base = 0) const {
+        if (order.empty() || newest[0] < min_ts) return;
+        const size_t first_leaf = (size_t(1) << levels) - 1;
+        const double INF = numeric_limits<double>::infinity();
+        auto bound_of = [&](size_t node) { return newest[node] < min_ts ? INF : box_dist2(node, q); };
+        pair<double,size_t> stack[64];
+        int sp = 0;
+        stack[sp++] = {box_dist2(0, q), 0};
+        alignas(32) double d2[LEAF_SIZE + LANES];
+        while (sp > 0) {
+            auto [bound, node] = stack[--sp];
+            if (bound >= top.worst) continue;
+            bool dead = false;
+            while (node < first_leaf) {
+                size_t lc = 2 * node + 1, rc = lc + 1;
+                double dl = bound_of(lc), dr = bound_of(rc);
+                if (dr < dl) { swap(lc, rc); swap(dl, dr); }
+                if (dr < top.worst) stack[sp++] = {dr, rc};
+                if (dl >= top.worst) { dead = true; break; }
+                node = lc;
+            }
+            if (dead) continue;
+            int lb = leaf_begin[node - first_leaf], le = leaf_begin[node - first_leaf + 1];
+            int cnt = le - lb;
+            const double *X = xs.data() + lb, *Y = ys.data() + lb, *Z = zs.data() + lb;
+            for (int j = 0; j < cnt; j += LANES) {
+                for (int t = 0; t < LANES; ++t) {   // fixed-width block: vectorizes at -O2
+                    double dx = X[j + t] - q.x, dy = Y[j + t] - q.y, dz = Z[j + t] - q.z;
+                    d2[j + t] = dx * dx + dy * dy + dz * dz;
+                }
+            }
+            for (int j = 0; j < cnt; ++j)
+                if (ts[lb + j] >= min_ts) top.offer(d2[j], id_base + lb + j);
+        }
+    }
+
+    vector<Neighbor> knn_query(double qlat, double qlon, int K, long min_ts = LONG_MIN) const {
         vector<Neighbor> result;
-        if (!root) return result;
-        priority_queue<pair<double,int>> maxheap; // pair<dist, idx>
-        knn_search(root, qlat, qlon, K, maxheap);
-        while (!maxheap.empty()) {
-            auto pr = maxheap.top(); maxheap.pop();
-            result.push_back({pr.first, data->at(pr.second).label, data->at(pr.second).id});
-        }
-        // result is in descending distance; reverse it
-        reverse(result.begin(), result.end());
+        if (!data || order.empty() || K <= 0) return result;
+        TopK top((int)min<size_t>(K, order.size()));
+        knn_search(to_unit_sphere(qlat, qlon), top, min_ts);
+        result.reserve(top.size);
+        for (int j = 0; j < top.size; ++j) {
+            const Point &p = (*data)[order[top.heap[j].second]];
+            result.push_back({haversine_distance_m(qlat, qlon, p.lat, p.lon), p.label, p.id,
+                              p.severity, p.timestamp});
+        }
+        sort(result.begin(), result.end());
         return result;
     }
 };
 
+// --------------------------- Dynamic Index ---------------------------------
+// Logarithmic method (Bentley-Saxe) over static KD-trees. Appended reports go
+// to a small buffer that queries scan linearly. When the buffer fills up it is
+// frozen, and a background thread merges it with the occupied levels 0..j-1
+// into a fresh tree at the first empty level j, so each report is rebuilt
+// O(log n) times overall. Until the merged tree is swapped in under the write
+// lock, queries keep reading the frozen buffer and the old levels. Appends
+// come from a single writer thread; queries may run concurrently with it.
+
+struct StaticLevel {
+    vector<Point> pts;
+    KDTree tree;        // built over pts, so a level never moves once built
+};
+
+struct PointBuffer {
+    vector<Point> pts;
+    vector<UnitVec> u;  // unit-sphere coordinates of pts
+    void push(const Point &p) { pts.push_back(p); u.push_back(to_unit_sphere(p.lat, p.lon)); }
+    void clear() { pts.clear(); u.clear(); }
+};
+
+class DynamicIndex {
+public:
+    static const size_t BUFFER_CAP = 1024;
+
+    ~DynamicIndex() { wait_for_merges(); }
+
+    // Builds the initial reports as one level, sized like a run of merges would.
+    void bulk_load(const vector<Point> &pts) {
+        wait_for_merges();
+        unique_lock<shared_mutex> lock(mu_);
+        levels_.clear();
+        buffer_.clear();
+        for (auto &p : pts) newest_ = max(newest_, p.timestamp);
+        if (pts.empty()) return;
+        size_t j = 0;
+        while ((BUFFER_CAP << j) < pts.size()) ++j;
+        levels_.resize(j + 1);
+        levels_[j] = make_level(pts);
+    }
+
+    void append(const Point &p) {
+        bool start = false;
+        {
+            unique_lock<shared_mutex> lock(mu_);
+            buffer_.push(p);
+            newest_ = max(newest_, p.timestamp);
+            if (buffer_.pts.size() >= BUFFER_CAP && !merging_) {
+                freeze_locked();
+                start = true;
+            }
+        }
+        if (start) {
+            if (merger_.joinable()) merger_.join(); // the previous run has already finished
+            merger_ = thread([this] { merge_loop(); });
+        }
+    }
+
+    void wait_for_merges() {
+        if (merger_.joinable()) merger_.join();
+    }
+
+    // K nearest reports with timestamp >= min_ts across the buffers and levels.
+    vector<Neighbor> knn_query(double qlat, double qlon, int K, long min_ts = LONG_MIN) const {
+        vector<Neighbor> result;
+        if (K <= 0) return result;
+        shared_lock<shared_mutex> lock(mu_);
+        const UnitVec q = to_unit_sphere(qlat, qlon);
+        // TopK ids are global: each level's slots, then the frozen buffer, then
+        // the live buffer, in one running numbering.
+        struct Part { int base; const StaticLevel *lv; const PointBuffer *buf; };
+        vector<Part> parts;
+        int base = 0;
+        for (auto &lv : levels_)
+            if (lv) { parts.push_back({base, lv.get(), nullptr}); base += (int)lv->pts.size(); }
+        for (const PointBuffer *b : {&frozen_, &buffer_})
+            if (!b->pts.empty()) { parts.push_back({base, nullptr, b}); base += (int)b->pts.size(); }
+        if (base == 0) return result;
+
+        TopK top((int)min<size_t>(K, base));
+        for (auto &pt : parts) {
+            if (pt.lv) { pt.lv->tree.knn_search(q, top, min_ts, pt.base); continue; }
+            const PointBuffer &b = *pt.buf;
+            for (size_t i = 0; i < b.pts.size(); ++i) {
+                if (b.pts[i].timestamp < min_ts) continue;
+                double dx = b.u[i].x - q.x, dy = b.u[i].y - q.y, dz = b.u[i].z - q.z;
+                top.offer(dx * dx + dy * dy + dz * dz, pt.base + (int)i);
+            }
+        }
+        result.reserve(top.size);
+        for (int j = 0; j < top.size; ++j) {
+            int id = top.heap[j].second;
+            size_t c = parts.size() - 1;
+            while (parts[c].base > id) --c;
+            int local = id - parts[c].base;
+            const Point &p = parts[c].lv ? parts[c].lv->pts[parts[c].lv->tree.order[local]]
+                                         : parts[c].buf->pts[local];
+            result.push_back({haversine_distance_m(qlat, qlon, p.lat, p.lon), p.label, p.id,
+                              p.severity, p.timestamp});
+        }
+        sort(result.begin(), result.end());
+        return result;
+    }
+
+    long newest_timestamp() const { shared_lock<shared_mutex> lock(mu_); return newest_; }
+
+    string describe() const {
+        shared_lock<shared_mutex> lock(mu_);
+        size_t n = buffer_.pts.size() + frozen_.pts.size();
+        string sizes;
+        for (auto &lv : levels_) {
+            if (!lv) continue;
+            n += lv->pts.size();
+            sizes += (sizes.empty() ? "" : "+") + to_string(lv->pts.size());
+        }
+        return to_string(n) + " reports: trees [" + (sizes.empty() ? "none" : sizes) + "], buffer "
+             + to_string(buffer_.pts.size() + frozen_.pts.size()) + ", merges " + to_string(merges_)
+             + (merging_ ? " (one running)" : "");
+    }
+
+private:
+    static shared_ptr<StaticLevel> make_level(vector<Point> pts) {
+        auto lv = make_shared<StaticLevel>();
+        lv->pts = move(pts);
+        lv->tree.build(lv->pts);
+        return lv;
+    }
+
+    // Moves the buffer into frozen_ and picks the merge target. Caller holds mu_.
+    void freeze_locked() {
+        swap(frozen_, buffer_);
+        target_ = 0;
+        while (target_ < levels_.size() && levels_[target_]) ++target_;
+        if (target_ == levels_.size()) levels_.push_back(nullptr);
+        merging_ = true;
+    }
+
+    // Runs on merger_. Only this thread changes frozen_ and levels_[0..target_]
+    // while merging_ is set, so it may read them without the lock.
+    void merge_loop() {
+        while (true) {
+            vector<Point> pts = frozen_.pts;
+            for (size_t i = 0; i < target_; ++i) {
+                auto &src = levels_[i]->pts;
+                pts.insert(pts.end(), src.begin(), src.end());
+            }
+            shared_ptr<StaticLevel> merged = make_level(move(pts));
+
+            unique_lock<shared_mutex> lock(mu_);
+            for (size_t i = 0; i < target_; ++i) levels_[i].reset();
+            levels_[target_] = merged;
+            frozen_.clear();
+            ++merges_;
+            if (buffer_.pts.size() < BUFFER_CAP) { merging_ = false; return; }
+            freeze_locked();
+        }
+    }
+
+    mutable shared_mutex mu_;
+    vector<shared_ptr<StaticLevel>> levels_;   // level i holds about BUFFER_CAP << i reports
+    PointBuffer buffer_, frozen_;
+    long newest_ = LONG_MIN;
+    size_t target_ = 0;                        // level the running merge fills
+    bool merging_ = false;
+    size_t merges_ = 0;
+    thread merger_;
+};
+
+// --------------------------- Risk Raster ----------------------------------
+// A raster is the classification precomputed at the centre of every cell of a
+// lat/lon grid, laid out so it can be mmap'd and served in place:
+//   RasterHeader | cells uint16[rows * cols]   (row-major, row 0 at the southern edge)
+// Each cell packs the label (bit 15), a boundary flag (bit 14) and the risk
+// fraction scaled to 0..16383. A cell is a boundary cell when one of its eight
+// neighbours has the other label or its fraction is within `margin` of 0.5;
+// those are the cells where the label can change inside the cell.
+// Values are stored in host byte order (the magic doubles as an endianness check).
+static const char RASTER_MAGIC[8] = {'K','N','N','R','A','S','T','R'};
+static const uint32_t RASTER_VERSION = 1;
+
+struct RasterHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t rows;
+    uint64_t cols;
+    double lat0, lon0;      // south-west corner
+    double dlat, dlon;      // cell size in degrees
+    double cell_m;          // requested cell size in meters
+    double margin;
+    int32_t k;              // classification settings the raster was built with
+    int32_t plain_vote;
+    uint64_t cells_pos;
+    uint64_t file_size;
+};
+
+struct RiskRaster {
+    static const uint16_t LABEL_BIT = 0x8000, BOUNDARY_BIT = 0x4000, FRACTION_MASK = 0x3fff;
+
+    RasterHeader h;
+    const uint16_t *cells = nullptr;    // into cells_store or the file mapping
+    vector<uint16_t> cells_store;
+    shared_ptr<void> mapping;
+
+    // Row-major cell index of (lat, lon), or -1 outside the raster.
+    int64_t cell_of(double lat, double lon) const {
+        double r = floor((lat - h.lat0) / h.dlat), c = floor((lon - h.lon0) / h.dlon);
+        if (!(r >= 0 && r < (double)h.rows && c >= 0 && c < (double)h.cols)) return -1;
+        return (int64_t)r * (int64_t)h.cols + (int64_t)c;
+    }
+    static int label(uint16_t cell) { return (cell & LABEL_BIT) ? 1 : 0; }
+    static bool boundary(uint16_t cell) { return (cell & BOUNDARY_BIT) != 0; }
+    static double fraction(uint16_t cell) { return (cell & FRACTION_MASK) / (double)FRACTION_MASK; }
+};
+
+// Evaluates `risk(lat, lon) -> risk fraction` at every cell centre. Work is
+// handed out in TILE x TILE tiles, so each thread's consecutive queries stay
+// close together, and boundary flags are set once all labels are known.
+template <class Risk>
+bool build_raster(double lat0, double lon0, double lat1, double lon1, double cell_m, double margin,
+                  int K, bool plain_vote, int threads, Risk risk, RiskRaster &out, string &err) {
+    const int TILE = 32;
+    const double M_PER_DEG = 6371000.0 * M_PI / 180.0;
+    if (!(lat1 > lat0 && lon1 > lon0 && cell_m > 0)) { err = "Empty raster bounds or cell size"; return false; }
+    RasterHeader &h = out.h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, RASTER_MAGIC, 8);
+    h.version = RASTER_VERSION;
+    h.header_size = sizeof(RasterHeader);
+    h.lat0 = lat0;
+    h.lon0 = lon0;
+    h.dlat = cell_m / M_PER_DEG;
+    h.dlon = cell_m / (M_PER_DEG * max(1e-6, cos(deg2rad((lat0 + lat1) / 2))));
+    h.rows = (uint64_t)ceil((lat1 - lat0) / h.dlat);
+    h.cols = (uint64_t)ceil((lon1 - lon0) / h.dlon);
+    h.cell_m = cell_m;
+    h.margin = margin;
+    h.k = K;
+    h.plain_vote = plain_vote ? 1 : 0;
+    h.cells_pos = (sizeof(RasterHeader) + 7) & ~(uint64_t)7;
+    if (h.rows * h.cols > (1ULL << 31)) { err = "Raster too large; use a bigger --cell-m"; return false; }
+    h.file_size = h.cells_pos + h.rows * h.cols * sizeof(uint16_t);
+
+    const int64_t rows = h.rows, cols = h.cols;
+    const int64_t trows = (rows + TILE - 1) / TILE, tcols = (cols + TILE - 1) / TILE;
+    vector<uint16_t> &cells = out.cells_store;
+    cells.assign(rows * cols, 0);
+    atomic<int64_t> next(0);
+    auto worker = [&]() {
+        for (int64_t t; (t = next.fetch_add(1)) < trows * tcols; ) {
+            int64_t r0 = t / tcols * TILE, c0 = t % tcols * TILE;
+            for (int64_t r = r0; r < min(rows, r0 + TILE); ++r) {
+                for (int64_t c = c0; c < min(cols, c0 + TILE); ++c) {
+                    double f = risk(lat0 + (r + 0.5) * h.dlat, lon0 + (c + 0.5) * h.dlon);
+                    uint16_t v = (uint16_t)lround(min(1.0, max(0.0, f)) * RiskRaster::FRACTION_MASK);
+                    if (f >= 0.5) v |= RiskRaster::LABEL_BIT;
+                    if (fabs(f - 0.5) < margin) v |= RiskRaster::BOUNDARY_BIT;
+                    cells[r * cols + c] = v;
+                }
+            }
+        }
+    };
+    threads = max(1, (int)min<int64_t>(threads, trows * tcols));
+    vector<thread> pool;
+    for (int i = 1; i < threads; ++i) pool.emplace_back(worker);
+    worker();
+    for (auto &t : pool) t.join();
+
+    for (int64_t r = 0; r < rows; ++r) {
+        for (int64_t c = 0; c < cols; ++c) {
+            uint16_t &v = cells[r * cols + c];
+            for (int64_t dr = -1; dr <= 1; ++dr)
+                for (int64_t dc = -1; dc <= 1; ++dc) {
+                    int64_t rr = r + dr, cc = c + dc;
+                    if (rr < 0 || rr >= rows || cc < 0 || cc >= cols) continue;
+                    if ((cells[rr * cols + cc] ^ v) & RiskRaster::LABEL_BIT) v |= RiskRaster::BOUNDARY_BIT;
+                }
+        }
+    }
+    out.cells = cells.data();
+    out.mapping.reset();
+    return true;
+}
+
+bool write_raster(const string &filename, const RiskRaster &rs, string &err) {
+    // Write to a temporary name and rename, so a crash never leaves a torn raster
+    string tmp = filename + ".tmp";
+    ofstream fout(tmp, ios::binary | ios::trunc);
+    if (!fout.is_open()) {
+        err = "Cannot open file for writing: " + tmp;
+        return false;
+    }
+    fout.write((const char*)&rs.h, sizeof(RasterHeader));
+    static const char zeros[8] = {0};
+    fout.write(zeros, (streamsize)(rs.h.cells_pos - sizeof(RasterHeader)));
+    fout.write((const char*)rs.cells, (streamsize)(rs.h.rows * rs.h.cols * sizeof(uint16_t)));
+    fout.close();
+    if (!fout) {
+        err = "Write failed for " + tmp;
+        return false;
+    }
+    if (rename(tmp.c_str(), filename.c_str()) != 0) {
+        err = "Cannot rename " + tmp + " to " + filename;
+        return false;
+    }
+    return true;
+}
+
+// Maps a raster read-only; lookups read the mapping directly, so start-up time
+// does not depend on the raster size.
+bool load_raster(const string &filename, RiskRaster &rs, string &err) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        err = "Cannot open file: " + filename;
+        return false;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) != 0 || (size_t)sb.st_size < sizeof(RasterHeader)) {
+        close(fd);
+        err = "Raster too small: " + filename;
+        return false;
+    }
+    size_t size = (size_t)sb.st_size;
+    void *base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping stays valid after close
+    if (base == MAP_FAILED) {
+        err = "mmap failed for " + filename;
+        return false;
+    }
+    shared_ptr<void> mapping(base, [size](void *p) { munmap(p, size); });
+    RasterHeader h;
+    memcpy(&h, base, sizeof(h));
+    if (memcmp(h.magic, RASTER_MAGIC, 8) != 0) {
+        err = "Not a risk raster (or written on a machine with different byte order): " + filename;
+        return false;
+    }
+    if (h.version != RASTER_VERSION || h.header_size != sizeof(RasterHeader)) {
+        err = "Unsupported raster version " + to_string(h.version) + " in " + filename;
+        return false;
+    }
+    if (h.file_size != size || h.rows == 0 || h.cols == 0 || h.rows * h.cols > (1ULL << 31) ||
+        h.cells_pos < h.header_size || h.cells_pos % 2 != 0 ||
+        h.cells_pos + h.rows * h.cols * sizeof(uint16_t) != size || !(h.dlat > 0 && h.dlon > 0)) {
+        err = "Corrupt or truncated raster: " + filename;
+        return false;
+    }
+    rs.h = h;
+    rs.cells_store.clear();
+    rs.cells = (const uint16_t*)((const char*)base + h.cells_pos);
+    rs.mapping = mapping;
+    return true;
+}
+
 // --------------------------- CSV Reader -----------------------------------
 
 bool load_crime_csv(const string &filename, vector<Point> &out, string &err) {
@@ -293,15 +911,246 @@ bool load_crime_csv(const string &filename, vector<Point> &out, string &err) {
     return true;
 }
 
+// --------------------------- Batch Engine ---------------------------------
+// Large batches are parsed in one pass, classified in Hilbert-curve order so
+// consecutive queries touch the same tree nodes and leaf buckets, and written
+// back in input order through a single buffered writer.
+
+struct BatchQuery { double lat, lon; };
+
+// Reads the whole file and parses "lat,lon" lines. Lines that do not start with
+// two numbers (headers, blank or malformed lines) are skipped and counted.
+bool load_batch_queries(const string &filename, vector<BatchQuery> &out, size_t &skipped, string &err) {
+    ifstream fin(filename, ios::binary);
+    if (!fin.is_open()) { err = "Cannot open batch file: " + filename; return false; }
+    string buf;
+    fin.seekg(0, ios::end);
+    buf.resize((size_t)max<streamoff>(0, fin.tellg()));
+    fin.seekg(0, ios::beg);
+    fin.read(&buf[0], (streamsize)buf.size());
+    buf.push_back('\0'); // strtod stops here at the latest
+
+    out.clear();
+    skipped = 0;
+    const char *p = buf.data(), *end = buf.data() + buf.size() - 1;
+    while (p < end) {
+        const char *eol = (const char*)memchr(p, '\n', end - p);
+        if (!eol) eol = end;
+        char *q;
+        double lat = strtod(p, &q);
+        bool ok = q != p;
+        if (ok) {
+            while (q < eol && (*q == ' ' || *q == '\t')) ++q;
+            ok = q < eol && *q == ',';
+        }
+        if (ok) {
+            const char *a = q + 1;
+            double lon = strtod(a, &q);
+            ok = q != a && q <= eol;
+            if (ok) out.push_back({lat, lon});
+        }
+        if (!ok) {
+            bool blank = true;
+            for (const char *c = p; c < eol && blank; ++c) blank = isspace((unsigned char)*c);
+            if (!blank) ++skipped;
+        }
+        p = eol + 1;
+    }
+    return true;
+}
+
+// Hilbert index of (x, y) on a 2^16 x 2^16 grid.
+uint64_t hilbert_index(uint32_t x, uint32_t y) {
+    uint64_t d = 0;
+    for (uint32_t s = 1u << 15; s > 0; s >>= 1) {
+        uint32_t rx = (x & s) ? 1 : 0, ry = (y & s) ? 1 : 0;
+        d += (uint64_t)s * s * ((3 * rx) ^ ry);
+        if (ry == 0) {
+            if (rx == 1) { x = s - 1 - x; y = s - 1 - y; }
+            swap(x, y);
+        }
+    }
+    return d;
+}
+
+// Query positions sorted along a Hilbert curve over the batch's bounding box.
+vector<int> hilbert_order(const vector<BatchQuery> &qs) {
+    double lat0 = 1e300, lat1 = -1e300, lon0 = 1e300, lon1 = -1e300;
+    for (auto &q : qs) {
+        lat0 = min(lat0, q.lat); lat1 = max(lat1, q.lat);
+        lon0 = min(lon0, q.lon); lon1 = max(lon1, q.lon);
+    }
+    double slat = 65535.0 / max(1e-12, lat1 - lat0), slon = 65535.0 / max(1e-12, lon1 - lon0);
+    vector<pair<uint64_t,int>> key(qs.size());
+    for (size_t i = 0; i < qs.size(); ++i) {
+        // NaN or infinite coordinates clamp to the grid edge
+        double hx = min(65535.0, max(0.0, (qs[i].lon - lon0) * slon));
+        double hy = min(65535.0, max(0.0, (qs[i].lat - lat0) * slat));
+        key[i] = {hilbert_index((uint32_t)(hx == hx ? hx : 0), (uint32_t)(hy == hy ? hy : 0)), (int)i};
+    }
+    sort(key.begin(), key.end());
+    vector<int> order(qs.size());
+    for (size_t i = 0; i < key.size(); ++i) order[i] = key[i].second;
+    return order;
+}
+
+// Classifies every query with `classify(lat, lon) -> label`. Workers claim
+// chunks of consecutive positions in Hilbert order and store each label at the
+// query's input index.
+template <class Classify>
+vector<unsigned char> classify_batch(const vector<BatchQuery> &qs, int threads, Classify classify) {
+    const size_t CHUNK = 1024;
+    vector<int> order = hilbert_order(qs);
+    vector<unsigned char> labels(qs.size());
+    atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t b; (b = next.fetch_add(CHUNK)) < order.size(); ) {
+            size_t e = min(order.size(), b + CHUNK);
+            for (size_t i = b; i < e; ++i) {
+                const BatchQuery &q = qs[order[i]];
+                labels[order[i]] = (unsigned char)classify(q.lat, q.lon);
+            }
+        }
+    };
+    threads = max(1, min<int>(threads, (int)((qs.size() + CHUNK - 1) / CHUNK)));
+    vector<thread> pool;
+    for (int t = 1; t < threads; ++t) pool.emplace_back(worker);
+    worker();
+    for (auto &t : pool) t.join();
+    return labels;
+}
+
+// Writes "lat,lon => Risky|Safe" lines in input order through a 1 MB buffer.
+bool write_batch_results(FILE *out, const vector<BatchQuery> &qs, const vector<unsigned char> &labels) {
+    const size_t BUF = 1 << 20;
+    vector<char> buf(BUF);
+    size_t used = 0;
+    bool ok = true;
+    for (size_t i = 0; i < qs.size(); ++i) {
+        if (BUF - used < 128) {
+            ok &= fwrite(buf.data(), 1, used, out) == used;
+            used = 0;
+        }
+        int len = snprintf(buf.data() + used, BUF - used, "%g,%g => %s\n",
+                           qs[i].lat, qs[i].lon, labels[i] == 1 ? "Risky" : "Safe");
+        used += (size_t)max(0, min(len, (int)(BUF - used - 1)));
+    }
+    ok &= fwrite(buf.data(), 1, used, out) == used;
+    return ok;
+}
+
+// --------------------------- Leave-one-out K Selection --------------------
+// One all-KNN pass finds every report's kmax nearest other reports. Reports are
+// visited in Hilbert order, so consecutive searches share tree nodes, and are
+// split across threads. Walking each neighbor list with running sums of the
+// vote weights scores every K <= kmax at once, so each K costs O(N) instead
+// of N more searches.
+
+struct LooScore {
+    int k;
+    double accuracy;
+    double precision;   // of the Risky predictions
+    double recall;      // share of Risky reports predicted Risky
+};
+
+// weight(neighbor) gives a neighbor's vote weight; a report is predicted Risky
+// when the risky share of the weight among its K nearest is >= 0.5, as in
+// classification. Reports older than min_ts neither vote nor get scored.
+template <class Weight>
+vector<LooScore> leave_one_out(const vector<Point> &data, const KDTree &tree, int kmax, long min_ts,
+                               int threads, Weight weight) {
+    vector<BatchQuery> pos;
+    vector<int> idx;
+    for (int i = 0; i < (int)data.size(); ++i) {
+        if (data[i].timestamp < min_ts) continue;
+        pos.push_back({data[i].lat, data[i].lon});
+        idx.push_back(i);
+    }
+    vector<int> order = hilbert_order(pos);
+    // per thread: [k] -> correct, true positives, predicted risky, actual risky
+    vector<vector<array<int64_t,4>>> counts(max(1, threads), vector<array<int64_t,4>>(kmax + 1));
+    atomic<size_t> next(0);
+    const size_t CHUNK = 256;
+    auto worker = [&](int t) {
+        auto &cnt = counts[t];
+        TopK top((int)min<size_t>(kmax + 1, data.size()));
+        vector<pair<double,int>> found;
+        for (size_t b; (b = next.fetch_add(CHUNK)) < order.size(); ) {
+            for (size_t o = b; o < min(order.size(), b + CHUNK); ++o) {
+                int self = idx[order[o]];
+                const Point &p = data[self];
+                top.reset();
+                tree.knn_search(to_unit_sphere(p.lat, p.lon), top, min_ts);
+                found.assign(top.heap.begin(), top.heap.begin() + top.size);
+                sort(found.begin(), found.end());
+                double risky = 0, total = 0;
+                int k = 0, pred = 0;
+                for (auto &f : found) {
+                    int j = tree.order[f.second];
+                    if (j == self || k == kmax) continue;
+                    const Point &q = data[j];
+                    Neighbor n{haversine_distance_m(p.lat, p.lon, q.lat, q.lon), q.label, string(),
+                               q.severity, q.timestamp};
+                    double w = weight(n);
+                    total += w;
+                    if (q.label == 1) risky += w;
+                    pred = (total > 0 && risky / total >= 0.5) ? 1 : 0;
+                    ++k;
+                    cnt[k][0] += (pred == p.label);
+                    cnt[k][1] += (pred == 1 && p.label == 1);
+                    cnt[k][2] += pred;
+                    cnt[k][3] += (p.label == 1);
+                }
+                // Fewer than kmax other reports: larger K sees the same neighbors
+                for (++k; k <= kmax; ++k) {
+                    cnt[k][0] += (pred == p.label);
+                    cnt[k][1] += (pred == 1 && p.label == 1);
+                    cnt[k][2] += pred;
+                    cnt[k][3] += (p.label == 1);
+                }
+            }
+        }
+    };
+    vector<thread> pool;
+    for (int t = 1; t < (int)counts.size(); ++t) pool.emplace_back(worker, t);
+    worker(0);
+    for (auto &th : pool) th.join();
+
+    vector<LooScore> scores;
+    for (int k = 1; k <= kmax; ++k) {
+        array<int64_t,4> c{};
+        for (auto &tc : counts)
+            for (int f = 0; f < 4; ++f) c[f] += tc[k][f];
+        scores.push_back({k, order.empty() ? 0.0 : (double)c[0] / order.size(),
+                          c[2] ? (double)c[1] / c[2] : 0.0, c[3] ? (double)c[1] / c[3] : 0.0});
+    }
+    return scores;
+}
+
 // --------------------------- Main and CLI ---------------------------------
 
 void print_usage() {
-    cerr << "Usage: knn_location_risk data.csv --mode [bruteforce|kdtree] --k K --query lat lon\n";
+    cerr << "Usage: knn_location_risk data.csv --mode [bruteforce|kdtree|dynamic] --k K --query lat lon\n";
     cerr << "Options:\n";
-    cerr << "  --mode    bruteforce (default) or kdtree\n";
+    cerr << "  --mode    bruteforce (default), kdtree, or dynamic (appendable index)\n";
     cerr << "  --k       number of neighbors (default 5)\n";
     cerr << "  --weight  voting weight: plain or inverse (default inverse)\n";
     cerr << "  --batch   batch query file with lines 'lat,lon'\n";
+    cerr << "  --out     write batch results to this file instead of stdout\n";
+    cerr << "  --threads worker threads for batch mode (default: all cores)\n";
+    cerr << "  --window  only count reports from the last N seconds\n";
+    cerr << "  --half-life  halve a report's vote every N seconds of age\n";
+    cerr << "  --severity-weight  scale each vote by the report's severity\n";
+    cerr << "  --now     reference time for --window/--half-life (default: newest report)\n";
+    cerr << "  --append  CSV of new reports appended one by one (dynamic mode)\n";
+    cerr << "  --build-raster  precompute the classification on a grid and write it to FILE\n";
+    cerr << "  --bounds  raster area lat0,lon0,lat1,lon1 (default: the reports' bounding box)\n";
+    cerr << "  --cell-m  raster cell size in meters (default 100)\n";
+    cerr << "  --margin  risk fractions within this of 0.5 mark boundary cells (default 0.1)\n";
+    cerr << "  --raster  answer queries from a prebuilt raster FILE\n";
+    cerr << "  --no-fallback  trust the raster in boundary cells too\n";
+    cerr << "  --eval-k  leave-one-out accuracy for every K up to this value, then exit\n";
+    cerr << "In dynamic mode, 'add,id,lat,lon,label[,severity[,timestamp]]' appends a report.\n";
 }
 
 int main(int argc, char** argv) {
@@ -312,6 +1161,20 @@ int main(int argc, char** argv) {
     string weight = "inverse";
     bool batch_mode = false;
     string batch_file;
+    string out_file;
+    int threads = max(1u, thread::hardware_concurrency());
+    long window = 0;            // seconds, 0 = all reports
+    double half_life = 0;       // seconds, 0 = no decay
+    bool by_severity = false;
+    bool has_now = false;
+    long fixed_now = 0;
+    string append_file;
+    string raster_out, raster_in;
+    double bounds[4] = {0, 0, 0, 0};
+    bool has_bounds = false;
+    double cell_m = 100.0, margin = 0.1;
+    bool fallback = true;
+    int eval_kmax = 0;
 
     // Simple CLI parsing
     for (int i=2;i<argc;++i) {
@@ -320,6 +1183,25 @@ int main(int argc, char** argv) {
         else if (s == "--k" && i+1<argc) { K = stoi(argv[++i]); }
         else if (s == "--weight" && i+1<argc) { weight = argv[++i]; }
         else if (s == "--batch" && i+1<argc) { batch_mode = true; batch_file = argv[++i]; }
+        else if (s == "--out" && i+1<argc) { out_file = argv[++i]; }
+        else if (s == "--threads" && i+1<argc) { threads = max(1, stoi(argv[++i])); }
+        else if (s == "--window" && i+1<argc) { window = max(0L, stol(argv[++i])); }
+        else if (s == "--half-life" && i+1<argc) { half_life = stod(argv[++i]); }
+        else if (s == "--severity-weight") { by_severity = true; }
+        else if (s == "--now" && i+1<argc) { has_now = true; fixed_now = stol(argv[++i]); }
+        else if (s == "--append" && i+1<argc) { append_file = argv[++i]; }
+        else if (s == "--build-raster" && i+1<argc) { raster_out = argv[++i]; }
+        else if (s == "--bounds" && i+1<argc) {
+            vector<string> f; parse_csv_line(argv[++i], f);
+            if (f.size() != 4) { cerr << "--bounds expects lat0,lon0,lat1,lon1\n"; return 1; }
+            for (int j = 0; j < 4; ++j) bounds[j] = stod(f[j]);
+            has_bounds = true;
+        }
+        else if (s == "--cell-m" && i+1<argc) { cell_m = stod(argv[++i]); }
+        else if (s == "--margin" && i+1<argc) { margin = stod(argv[++i]); }
+        else if (s == "--raster" && i+1<argc) { raster_in = argv[++i]; }
+        else if (s == "--no-fallback") { fallback = false; }
+        else if (s == "--eval-k" && i+1<argc) { eval_kmax = max(1, stoi(argv[++i])); }
         else if (s == "--help") { print_usage(); return 0; }
     }
 
@@ -332,45 +1214,193 @@ int main(int argc, char** argv) {
     }
     cout << "Loaded " << data.size() << " points.\n";
 
+    if (!append_file.empty() && mode != "dynamic") {
+        cerr << "Note: --append needs the appendable index; using --mode dynamic.\n";
+        mode = "dynamic";
+    }
+    if (window > 0 && mode == "bruteforce") {
+        cerr << "Note: --window skips expired reports inside the tree search; using --mode kdtree.\n";
+        mode = "kdtree";
+    }
+    long data_newest = LONG_MIN;
+    for (auto &p : data) data_newest = max(data_newest, p.timestamp);
+
     // Build KD-tree if requested
     KDTree tree;
+    BruteForceIndex brute;
+    DynamicIndex dynamic;
+    if (mode == "dynamic") {
+        cout << "Building dynamic index ...\n";
+        dynamic.bulk_load(data);
+        if (!append_file.empty()) {
+            vector<Point> extra;
+            if (!load_crime_csv(append_file, extra, err)) {
+                cerr << "Error: " << err << "\n";
+                return 1;
+            }
+            auto t0 = chrono::steady_clock::now();
+            for (auto &p : extra) dynamic.append(p);
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+            cout << "Appended " << extra.size() << " reports in " << ms << " ms ("
+                 << (size_t)(extra.size() / max(1e-6, ms / 1000.0)) << " reports/s).\n";
+        }
+        cout << "Dynamic index: " << dynamic.describe() << ".\n";
+    } else if (mode != "kdtree") {
+        brute.build(data);
+        cout << "Brute-force scan uses the " << brute.kernel << " kernel.\n";
+    }
     if (mode == "kdtree") {
         cout << "Building KD-tree ...\n";
         tree.build(data);
         cout << "KD-tree built.\n";
     }
 
-    auto classify_point = [&](double qlat, double qlon) -> pair<int, vector<Neighbor>> {
+    // Exact classification: the K nearest reports and their risk fraction
+    // (the location is Risky when the fraction is >= 0.5).
+    auto score_point = [&](double qlat, double qlon) -> pair<double, vector<Neighbor>> {
         vector<Neighbor> neighbors;
+        long now = has_now ? fixed_now : mode == "dynamic" ? dynamic.newest_timestamp() : data_newest;
+        long min_ts = window > 0 ? now - window : LONG_MIN;
         if (mode == "kdtree") {
-            neighbors = tree.knn_query(qlat, qlon, K);
+            neighbors = tree.knn_query(qlat, qlon, K, min_ts);
+        } else if (mode == "dynamic") {
+            neighbors = dynamic.knn_query(qlat, qlon, K, min_ts);
         } else {
-            neighbors = knn_bruteforce(data, qlat, qlon, K);
+            neighbors = brute.knn_query(qlat, qlon, K);
         }
 
         // Voting
-        int label = 0;
-        if (weight == "plain") label = majority_vote(neighbors);
-        else {
-            double frac = weighted_vote(neighbors);
-            // Threshold 0.5
-            label = (frac >= 0.5) ? 1 : 0;
-        }
-        return {label, neighbors};
+        double frac = 0.0;
+        if (neighbors.empty()) frac = 0.0; // no report inside the window
+        else if (half_life > 0 || by_severity) frac = decayed_vote(neighbors, now, half_life, by_severity, weight != "plain");
+        else if (weight == "plain") frac = majority_vote(neighbors);
+        else frac = weighted_vote(neighbors);
+        return {frac, neighbors};
+    };
+
+    if (eval_kmax > 0) {
+        // The initial reports only; appended ones are not part of the evaluation
+        KDTree eval_tree;
+        if (mode != "kdtree") eval_tree.build(data);
+        const KDTree &et = mode == "kdtree" ? tree : eval_tree;
+        long now = has_now ? fixed_now : data_newest;
+        long min_ts = window > 0 ? now - window : LONG_MIN;
+        auto t0 = chrono::steady_clock::now();
+        vector<LooScore> scores = leave_one_out(data, et, eval_kmax, min_ts, threads, [&](const Neighbor &n) {
+            return vote_weight(n, now, half_life, by_severity, weight != "plain");
+        });
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+        cout << "Leave-one-out over " << data.size() << " reports for K = 1.." << eval_kmax << " in "
+             << ms << " ms on " << threads << " thread(s).\n";
+        ofstream fl("loo_accuracy.csv");
+        fl << "k,accuracy,precision,recall\n";
+        const LooScore *best = nullptr;
+        cout << "   K  accuracy  precision  recall\n";
+        for (auto &sc : scores) {
+            fl << sc.k << "," << sc.accuracy << "," << sc.precision << "," << sc.recall << "\n";
+            cout << setw(4) << sc.k << fixed << setprecision(4) << setw(10) << sc.accuracy
+                 << setw(11) << sc.precision << setw(8) << sc.recall << "\n";
+            if (!best || sc.accuracy > best->accuracy) best = &sc;
+        }
+        cout.unsetf(ios::fixed);
+        if (best) cout << "Best K = " << best->k << " (accuracy " << best->accuracy << "). Wrote 'loo_accuracy.csv'.\n";
+        return 0;
+    }
+
+    if (!raster_out.empty()) {
+        double lat0 = bounds[0], lon0 = bounds[1], lat1 = bounds[2], lon1 = bounds[3];
+        if (!has_bounds) {
+            lat0 = lon0 = 1e300;
+            lat1 = lon1 = -1e300;
+            for (auto &p : data) {
+                lat0 = min(lat0, p.lat); lat1 = max(lat1, p.lat);
+                lon0 = min(lon0, p.lon); lon1 = max(lon1, p.lon);
+            }
+        }
+        RiskRaster built;
+        auto t0 = chrono::steady_clock::now();
+        if (!build_raster(lat0, lon0, lat1, lon1, cell_m, margin, K, weight == "plain", threads,
+                          [&](double lat, double lon) { return score_point(lat, lon).first; }, built, err) ||
+            !write_raster(raster_out, built, err)) {
+            cerr << "Error: " << err << "\n";
+            return 1;
+        }
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+        size_t ncells = built.h.rows * built.h.cols, nboundary = 0, nrisky = 0;
+        for (size_t i = 0; i < ncells; ++i) {
+            nboundary += RiskRaster::boundary(built.cells[i]);
+            nrisky += RiskRaster::label(built.cells[i]);
+        }
+        cout << "Built " << built.h.rows << "x" << built.h.cols << " raster (" << cell_m << " m cells) in "
+             << ms << " ms on " << threads << " thread(s), " << (size_t)(ncells / max(1e-6, ms / 1000.0))
+             << " cells/s: " << nrisky << " risky, " << nboundary << " boundary cells. Wrote '"
+             << raster_out << "' (" << built.h.file_size << " bytes).\n";
+        return 0;
+    }
+
+    RiskRaster raster;
+    if (!raster_in.empty()) {
+        if (!load_raster(raster_in, raster, err)) {
+            cerr << "Error: " << err << "\n";
+            return 1;
+        }
+        cout << "Mapped " << raster.h.rows << "x" << raster.h.cols << " risk raster (" << raster.h.cell_m
+             << " m cells, K=" << raster.h.k << ")" << (fallback ? " with exact fallback in boundary cells" : "")
+             << ".\n";
+        if (raster.h.k != K || raster.h.plain_vote != (weight == "plain"))
+            cerr << "Warning: raster was built with K=" << raster.h.k << (raster.h.plain_vote ? ", plain" : ", inverse")
+                 << " voting; the exact fallback uses the current settings.\n";
+    }
+    atomic<size_t> raster_hits(0), raster_misses(0);
+
+    // Raster cells answer directly; boundary cells (unless --no-fallback) and
+    // points outside the raster fall back to the exact search. Neighbors are
+    // only returned by the exact path.
+    auto classify_point = [&](double qlat, double qlon) -> pair<int, vector<Neighbor>> {
+        if (raster.cells) {
+            int64_t c = raster.cell_of(qlat, qlon);
+            if (c >= 0 && !(fallback && RiskRaster::boundary(raster.cells[c]))) {
+                raster_hits.fetch_add(1, memory_order_relaxed);
+                return {RiskRaster::label(raster.cells[c]), {}};
+            }
+            raster_misses.fetch_add(1, memory_order_relaxed);
+        }
+        auto scored = score_point(qlat, qlon);
+        return {scored.first >= 0.5 ? 1 : 0, move(scored.second)};
     };
 
     if (batch_mode) {
-        ifstream fin(batch_file);
-        if (!fin.is_open()) { cerr << "Cannot open batch file\n"; return 1; }
-        string line;
-        while (getline(fin, line)) {
-            vector<string> f; parse_csv_line(line, f);
-            if (f.size() < 2) continue;
-            double lat = stod(f[0]); double lon = stod(f[1]);
-            auto res = classify_point(lat, lon);
-            cout << lat << "," << lon << " => " << (res.first==1 ? "Risky" : "Safe") << "\n";
-        }
-        fin.close();
+        vector<BatchQuery> queries;
+        size_t skipped = 0;
+        auto t0 = chrono::steady_clock::now();
+        if (!load_batch_queries(batch_file, queries, skipped, err)) { cerr << err << "\n"; return 1; }
+        if (skipped > 0) cerr << "Warning: skipped " << skipped << " malformed batch line(s).\n";
+        auto t1 = chrono::steady_clock::now();
+        vector<unsigned char> labels = classify_batch(queries, threads,
+            [&](double lat, double lon) { return classify_point(lat, lon).first; });
+        auto t2 = chrono::steady_clock::now();
+
+        FILE *out = stdout;
+        if (!out_file.empty() && !(out = fopen(out_file.c_str(), "wb"))) {
+            cerr << "Cannot open output file: " << out_file << "\n";
+            return 1;
+        }
+        cout.flush();
+        bool written = write_batch_results(out, queries, labels);
+        written &= (out == stdout ? fflush(out) : fclose(out)) == 0;
+        if (!written) { cerr << "Error writing batch results\n"; return 1; }
+        auto t3 = chrono::steady_clock::now();
+
+        auto ms = [](chrono::steady_clock::time_point a, chrono::steady_clock::time_point b) {
+            return chrono::duration<double, milli>(b - a).count();
+        };
+        double classify_ms = ms(t1, t2);
+        cout << "Classified " << queries.size() << " queries on " << threads << " thread(s) in "
+             << classify_ms << " ms (" << (size_t)(queries.size() / max(1e-6, classify_ms / 1000.0))
+             << " queries/s; parse " << ms(t0, t1) << " ms, write " << ms(t2, t3) << " ms).\n";
+        if (raster.cells)
+            cout << "Raster answered " << raster_hits.load() << " queries; " << raster_misses.load()
+                 << " went to the exact search.\n";
         return 0;
     }
 
@@ -384,12 +1414,39 @@ int main(int argc, char** argv) {
         if (line.empty()) continue;
         if (line == "exit" || line == "quit") break;
         vector<string> parts; parse_csv_line(line, parts);
+        if (parts[0] == "add") {
+            if (mode != "dynamic") { cerr << "Appending reports needs --mode dynamic\n"; continue; }
+            if (parts.size() < 5) { cerr << "Please enter: add,id,lat,lon,label[,severity[,timestamp]]\n"; continue; }
+            Point p;
+            try {
+                p.id = parts[1];
+                p.lat = stod(parts[2]);
+                p.lon = stod(parts[3]);
+                p.label = stoi(parts[4]);
+                p.severity = parts.size() > 5 ? stoi(parts[5]) : 1;
+                p.timestamp = parts.size() > 6 ? stol(parts[6]) : (long)time(nullptr);
+            } catch (...) {
+                cerr << "Invalid report\n";
+                continue;
+            }
+            dynamic.append(p);
+            cout << "Added " << p.id << " (" << dynamic.describe() << ")\n";
+            continue;
+        }
         if (parts.size() < 2) { cerr << "Please enter: lat,lon\n"; continue; }
         double qlat = stod(parts[0]);
         double qlon = stod(parts[1]);
         auto res = classify_point(qlat, qlon);
         int label = res.first;
         cout << (label==1 ? "Risky" : "Safe") << "\n";
+        if (res.second.empty() && raster.cells) {
+            int64_t c = raster.cell_of(qlat, qlon);
+            if (c >= 0) {
+                cout << "From raster cell (risk fraction " << fixed << setprecision(2)
+                     << RiskRaster::fraction(raster.cells[c]) << ")\n";
+                continue;
+            }
+        }
         cout << "Nearest neighbors (dist meters, label, id):\n";
         for (const auto &n : res.second) {
             cout << "  " << fixed << setprecision(1) << n.dist << "m, label=" << n.label << ", id=" << n.id << "\n";
@@ -8,11 +8,13 @@
 //  - Query top-k suggestions by prefix (case-insensitive)
 //  - Maintain frequency counts for ranking suggestions
 //  - Support deletion of entries
-//  - Optional fuzzy fallback using simple Levenshtein scan for small datasets
+//  - Optional fuzzy fallback: bounded edit-distance search over the trie
 //  - Interactive REPL and batch query mode
+//  - Lock-free queries on epoch-protected snapshots; writes published in batches
+//  - Multi-threaded query throughput benchmark (--bench)
 //
-// Note: This is an educational implementation; production systems use optimised
-// tries (radix/compressed), disk-backed stores, and persistence.
+// The trie is path-compressed and lives in chunked arenas (see Radix Trie below);
+// persistence and disk-backed stores are out of scope.
 
 #include <bits/stdc++.h>
 using namespace std;
@@ -27,38 +29,62 @@ static inline void trim(string &s) {
     s = s.substr(a, b - a + 1);
 }
 
-static inline string to_lower_normalize(const string &s) {
-    string out;
-    out.reserve(s.size());
-    for (char ch : s) {
-        // normalize: convert to lowercase, keep alphanum and basic punctuation/spaces
-        char c = ch;
-        if (unsigned char(c) >= 128) {
-            // skip non-ascii accents for simplicity; production should use unicode normalization
-            continue;
-        }
-        if (isalpha((unsigned char)c)) out.push_back(tolower((unsigned char)c));
-        else if (isdigit((unsigned char)c)) out.push_back(c);
-        else if (isspace((unsigned char)c)) out.push_back(' ');
-        else if (c == ',' || c == '.' || c == '-' || c == '&' || c == '/') out.push_back(c);
-        // else skip other symbols
-    }
-    // collapse multiple spaces
-    string res;
-    bool was_space = false;
-    for (char ch : out) {
-        if (ch == ' ') {
-            if (!was_space) { res.push_back(ch); was_space = true; }
-        } else {
-            res.push_back(ch);
-            was_space = false;
-        }
+// Output byte for each ASCII input: lowercase letter, digit, kept
+// punctuation, ' ' for any whitespace, or 0 to drop it
+static const array<char, 128> NORMALIZE_MAP = [] {
+    array<char, 128> m{};
+    for (int c = 0; c < 128; ++c) {
+        if (isalpha(c)) m[c] = (char)tolower(c);
+        else if (isdigit(c)) m[c] = (char)c;
+        else if (isspace(c)) m[c] = ' ';
+        else if (c == ',' || c == '.' || c == '-' || c == '&' || c == '/') m[c] = (char)c;
+    }
+    return m;
+}();
+
+// Normalize s[0, n) into out (which needs room for n bytes); returns the length.
+// normalize: convert to lowercase, keep alphanum and basic punctuation/spaces,
+// collapse runs of spaces and trim them at both ends
+static inline size_t normalize_into(const char *s, size_t n, char *out) {
+    size_t len = 0;
+    for (size_t i = 0; i < n; ++i) {
+        unsigned char c = (unsigned char)s[i];
+        // skip non-ascii accents for simplicity; production should use unicode normalization
+        if (c >= 128) continue;
+        char m = NORMALIZE_MAP[c];
+        if (m == 0) continue;
+        if (m == ' ' && (len == 0 || out[len - 1] == ' ')) continue;
+        out[len++] = m;
     }
-    trim(res);
-    return res;
+    if (len > 0 && out[len - 1] == ' ') --len;
+    return len;
 }
 
-// --------------------------- Trie Node ------------------------------------
+static inline string to_lower_normalize(const string &s) {
+    string out(s.size(), '\0');
+    out.resize(normalize_into(s.data(), s.size(), &out[0]));
+    return out;
+}
+
+// --------------------------- Radix Trie -----------------------------------
+//
+// Path-compressed trie over normalized keys. Instead of one heap node per
+// character, everything lives in a handful of chunked arenas addressed by
+// 32-bit ids, so a descent touches one small record per branching point:
+//   nodes        fixed 32-byte records; `root` is the writer's current root
+//   labels       edge label bytes; each node's label is a slice of its own
+//   slots        each node's children as one contiguous range of (first
+//                character, node id) pairs sorted by character
+//   caches       CACHE_CAP entry ids per block, held only by nodes whose
+//                subtree has more than CACHE_CAP live entries; smaller
+//                subtrees are enumerated directly when queried
+//   entries      one record per stored key, raw display text in key_text
+//
+// Updates never write a record a reader may hold. They copy the nodes on the
+// key's path (with their child ranges and cache blocks) and the entry they
+// change, and leave everything else shared with the previous version. The
+// replaced records are retired and recycled after the grace period (see
+// Snapshots below).
 
 struct Suggestion {
     string key;      // full string (e.g., "Name, Address")
@@ -66,216 +92,1008 @@ struct Suggestion {
     uint64_t last_ts; // last-used timestamp for recency tie-break
 };
 
-struct TrieNode {
-    // For simplicity using unordered_map for children to support large char set.
-    unordered_map<char, TrieNode*> children;
-    bool is_end = false;
-    // if node corresponds to an entry end, store an index to suggestion store
-    vector<int> suggestion_indices; // indices into global suggestion pool for entries ending here (usually 1)
-    // We also keep top suggestions cache for this subtree to accelerate queries
-    // (store indices to global suggestions and maintain it upon inserts/deletes)
-    vector<int> top_cache; // stores indices into global suggestions, sorted by score
-    mutable std::shared_mutex node_mutex; // to allow concurrent reads and safe updates
+static const uint32_t CACHE_CAP = 10; // how many top suggestions we cache per node
+static const uint32_t NIL = UINT32_MAX;
+
+struct Entry {
+    uint64_t key_pos;  // raw key is key_text[key_pos, key_pos + key_len)
+    uint32_t key_len;
+    uint64_t freq;     // 0 once deleted
+    uint64_t last_ts;
 };
 
-// --------------------------- Global store ---------------------------------
+struct ChildSlot {
+    char first;   // first byte of the child's edge label
+    uint32_t id;
+};
 
-// Global vector of suggestions (strings and metadata)
-vector<Suggestion> suggestion_store;
+struct RadixNode {
+    uint32_t label_pos;   // edge label is labels[label_pos, label_pos + label_len)
+    uint32_t label_len;
+    uint32_t children;    // slots [children, children + child_count)
+    uint16_t child_count;
+    uint16_t child_cap;
+    int32_t entry;        // entry whose key ends here, -1 if none
+    uint32_t subtree;     // live entries in this subtree
+    uint32_t cache;       // block in caches, NIL while the subtree is small
+    uint32_t cache_len;
+};
 
-// Map from key string to index in suggestion_store
-unordered_map<string, int> key_to_index;
+struct CacheBlock {
+    int32_t e[CACHE_CAP];
+};
 
-// Root of trie
-TrieNode *root = nullptr;
+// Compute score for suggestion: primary freq, secondary recent ts
+uint64_t compute_score(const Entry &e) {
+    // score = (freq << 32) | (last_ts & 0xffffffff)
+    return (e.freq << 32) | (e.last_ts & 0xffffffff);
+}
 
-// Parameters
-size_t MAX_CACHE_PER_NODE = 10; // how many top suggestions we cache per node
+// Records in chunks that never move: chunk k holds 256 << k of them, so a
+// position maps to its chunk with one bit scan and a reader can follow any
+// published position while the writer appends. alloc(n) returns n contiguous
+// records, skipping the tail of a chunk that cannot hold them.
+template <class T>
+class ChunkArena {
+public:
+    uint64_t size() const { return size_; }
+    T *ptr(uint64_t pos) { int k = chunk_of(pos); return chunks_[k].get() + (pos - chunk_start(k)); }
+    const T *ptr(uint64_t pos) const { int k = chunk_of(pos); return chunks_[k].get() + (pos - chunk_start(k)); }
+    T &operator[](uint64_t pos) { return *ptr(pos); }
+    const T &operator[](uint64_t pos) const { return *ptr(pos); }
 
-// Lock for suggestion store writes
-std::mutex store_mutex;
+    // Position the next alloc(n) will return
+    uint64_t next_pos(uint64_t n) const {
+        uint64_t pos = size_;
+        while (pos + n > chunk_start(chunk_of(pos) + 1)) pos = chunk_start(chunk_of(pos) + 1);
+        return pos;
+    }
+    uint64_t alloc(uint64_t n) {
+        uint64_t pos = next_pos(n);
+        int k = chunk_of(pos);
+        // default-initialized: pages are only touched once records land there
+        if (!chunks_[k]) chunks_[k].reset(new T[chunk_start(k + 1) - chunk_start(k)]);
+        size_ = pos + n;
+        return pos;
+    }
+    uint64_t push_back(const T &x) { uint64_t pos = alloc(1); *ptr(pos) = x; return pos; }
+    uint64_t append(const T *x, uint64_t n) { uint64_t pos = alloc(n); copy(x, x + n, ptr(pos)); return pos; }
+    void clear() { for (auto &c : chunks_) c.reset(); size_ = 0; }
+    size_t memory_bytes() const {
+        size_t b = 0;
+        for (int k = 0; k < MAX_CHUNKS; ++k)
+            if (chunks_[k]) b += (chunk_start(k + 1) - chunk_start(k)) * sizeof(T);
+        return b;
+    }
 
-// --------------------------- Ranking helpers -------------------------------
+private:
+    static const int BASE_BITS = 8, MAX_CHUNKS = 40;
+    static int chunk_of(uint64_t pos) { return 63 - __builtin_clzll(pos + (1ull << BASE_BITS)) - BASE_BITS; }
+    static uint64_t chunk_start(int k) { return (1ull << (k + BASE_BITS)) - (1ull << BASE_BITS); }
+    unique_ptr<T[]> chunks_[MAX_CHUNKS];
+    uint64_t size_ = 0;
+};
 
-// Compute score for suggestion: primary freq, secondary recent ts
-uint64_t compute_score(const Suggestion &s) {
-    // Combine frequency and timestamp in 64-bit score (freq high bits)
-    // freq up to 2^48 and last_ts up to 2^16 approx; here simple combination:
-    // score = (freq << 32) | (last_ts & 0xffffffff)
-    return (s.freq << 32) | (s.last_ts & 0xffffffff);
-}
+// Rows for the bulk builder, stored back to back instead of one string each.
+// bulk_load fills norm with the normalized keys at the same offsets.
+struct BulkInput {
+    string raw;                        // row i is raw[start[i], start[i + 1])
+    vector<uint64_t> start{0};
+    vector<uint64_t> ts;
+    string norm;
+    vector<uint32_t> norm_len;
 
-// Compare two indices by suggestion score (higher first), fallback lexicographic
-bool suggestion_cmp_idx(int a, int b) {
-    const Suggestion &sa = suggestion_store[a];
-    const Suggestion &sb = suggestion_store[b];
-    uint64_t ra = compute_score(sa);
-    uint64_t rb = compute_score(sb);
-    if (ra != rb) return ra > rb;
-    if (sa.key != sb.key) return sa.key < sb.key;
-    return a < b;
-}
+    void add(const string &key, uint64_t timestamp) {
+        raw += key;
+        start.push_back(raw.size());
+        ts.push_back(timestamp);
+    }
+    size_t size() const { return ts.size(); }
+    string_view raw_of(size_t i) const { return string_view(raw.data() + start[i], start[i + 1] - start[i]); }
+    string_view norm_of(size_t i) const { return string_view(norm.data() + start[i], norm_len[i]); }
+};
+
+struct RadixTrie {
+    // Records unlinked from the trie but possibly still held by readers
+    struct Garbage {
+        vector<uint32_t> nodes, caches;
+        vector<int32_t> entries;
+        vector<pair<uint32_t,uint16_t>> slots;   // (first slot, capacity)
+        void clear() { nodes.clear(); caches.clear(); entries.clear(); slots.clear(); }
+        size_t memory_bytes() const {
+            return (nodes.capacity() + caches.capacity() + entries.capacity()) * sizeof(uint32_t)
+                 + slots.capacity() * sizeof(pair<uint32_t,uint16_t>);
+        }
+    };
+
+    ChunkArena<RadixNode> nodes;
+    ChunkArena<char> labels;
+    ChunkArena<ChildSlot> slots;
+    ChunkArena<CacheBlock> caches;
+    ChunkArena<Entry> entries;
+    ChunkArena<char> key_text;
+    uint32_t root = 0;
+    size_t live = 0;
+    vector<uint32_t> free_nodes;
+    vector<uint32_t> free_slots[9];   // released child ranges by log2(capacity)
+    vector<uint32_t> free_caches;
+    vector<int32_t> free_entries;
+    Garbage retired;                  // unlinked by the updates since the last publish
+    Garbage limbo;                    // unlinked by the last published batch
+    vector<char> fresh;               // node created since the last publish, writable in place
+    vector<uint32_t> fresh_nodes;
+    vector<uint32_t> path;            // scratch for writers
+    vector<int> scratch;
+    typedef pair<const int32_t*, const int32_t*> Run;
+    vector<Run> runs;
+
+    RadixTrie() { clear(); }
+
+    void clear() {
+        nodes.clear(); labels.clear(); slots.clear();
+        caches.clear(); entries.clear(); key_text.clear();
+        free_nodes.clear();
+        for (auto &f : free_slots) f.clear();
+        free_caches.clear(); free_entries.clear();
+        retired.clear(); limbo.clear();
+        fresh.clear(); fresh_nodes.clear();
+        root = new_node(0, 0);
+        live = 0;
+    }
+
+    string_view key_of(int idx) const {
+        const Entry &e = entries[idx];
+        return string_view(key_text.ptr(e.key_pos), e.key_len);
+    }
+
+    // Higher score first, then lexicographic on the raw key, then insertion order
+    bool better(int a, int b) const {
+        uint64_t ra = compute_score(entries[a]);
+        uint64_t rb = compute_score(entries[b]);
+        if (ra != rb) return ra > rb;
+        int c = key_of(a).compare(key_of(b));
+        if (c != 0) return c < 0;
+        return a < b;
+    }
+
+    uint32_t child(uint32_t v, char ch) const {
+        const RadixNode &n = nodes[v];
+        const ChildSlot *s = slots.ptr(n.children), *e = s + n.child_count;
+        for (; s != e; ++s)
+            if (s->first == ch) return s->id;
+        return NIL;
+    }
 
-// Merge top caches: node cache is kept up to MAX_CACHE_PER_NODE best suggestions
-void merge_into_cache(vector<int> &cache, int idx) {
-    // if idx already present, update it
-    for (int &x : cache) {
-        if (x == idx) {
-            // resort
-            sort(cache.begin(), cache.end(), suggestion_cmp_idx);
-            if (cache.size() > MAX_CACHE_PER_NODE) cache.resize(MAX_CACHE_PER_NODE);
+    // Number of leading label bytes of n that match s from position i
+    uint32_t common(const RadixNode &n, const string &s, size_t i) const {
+        uint32_t m = (uint32_t)min<size_t>(n.label_len, s.size() - i);
+        const char *l = labels.ptr(n.label_pos);
+        uint32_t j = 0;
+        while (j < m && l[j] == s[i + j]) ++j;
+        return j;
+    }
+
+    // Node reached by a prefix from version root `from` (it may end inside
+    // that node's edge), or NIL
+    uint32_t find_prefix(uint32_t from, const string &norm) const {
+        uint32_t v = from;
+        size_t i = 0;
+        while (i < norm.size()) {
+            uint32_t c = child(v, norm[i]);
+            if (c == NIL) return NIL;
+            uint32_t j = common(nodes[c], norm, i);
+            if (j < nodes[c].label_len && i + j < norm.size()) return NIL;
+            i += j;
+            v = c;
+        }
+        return v;
+    }
+
+    // Node where the whole key ends, recording the root-to-node path
+    uint32_t find_exact(const string &norm, vector<uint32_t> &out_path) const {
+        out_path.assign(1, root);
+        uint32_t v = root;
+        size_t i = 0;
+        while (i < norm.size()) {
+            uint32_t c = child(v, norm[i]);
+            if (c == NIL) return NIL;
+            uint32_t j = common(nodes[c], norm, i);
+            if (j < nodes[c].label_len) return NIL;
+            i += j;
+            v = c;
+            out_path.push_back(v);
+        }
+        return v;
+    }
+
+    // Insert a key or bump its frequency; returns the entry index
+    int upsert(const string &norm, const string &raw, uint64_t timestamp) {
+        if (labels.next_pos(norm.size()) + norm.size() > UINT32_MAX || nodes.size() + norm.size() + 3 >= NIL
+            || entries.size() >= (uint64_t)INT32_MAX) return -1;
+        root = clone(root);
+        path.assign(1, root);
+        uint32_t v = root;
+        size_t i = 0;
+        while (i < norm.size()) {
+            uint32_t c = child(v, norm[i]);
+            if (c == NIL) {
+                uint32_t len = (uint32_t)(norm.size() - i);
+                uint32_t leaf = new_node((uint32_t)labels.append(norm.data() + i, len), len);
+                add_child(v, leaf);
+                v = leaf;
+                path.push_back(v);
+                break;
+            }
+            uint32_t j = common(nodes[c], norm, i);
+            uint32_t copy = clone(c);
+            replace_child(v, c, copy);
+            c = copy;
+            if (j < nodes[c].label_len) {
+                // split the edge: mid keeps the shared part, c the remainder
+                uint32_t mid = new_node(nodes[c].label_pos, j);
+                nodes[mid].subtree = nodes[c].subtree;
+                nodes[c].label_pos += j;
+                nodes[c].label_len -= j;
+                replace_child(v, c, mid);
+                add_child(mid, c);
+                c = mid;
+            }
+            v = c;
+            path.push_back(v);
+            i += j;
+        }
+        int idx = nodes[v].entry;
+        if (idx >= 0) {
+            // exists -> a copy with freq incremented and ts updated replaces it
+            Entry e = entries[idx];
+            e.freq += 1;
+            e.last_ts = timestamp;
+            int bumped = new_entry(e);
+            retired.entries.push_back(idx);
+            nodes[v].entry = bumped;
+            for (uint32_t p : path) {
+                RadixNode &n = nodes[p];
+                if (n.cache == NIL) continue;
+                int32_t *c = caches[n.cache].e;
+                for (uint32_t s = 0; s < n.cache_len; ++s) if (c[s] == idx) c[s] = bumped;
+            }
+            idx = bumped;
+        } else {
+            idx = new_entry({key_text.append(raw.data(), raw.size()), (uint32_t)raw.size(), 1, timestamp});
+            nodes[v].entry = idx;
+            for (uint32_t p : path) nodes[p].subtree += 1;
+            ++live;
+        }
+        // the score only went up, so existing caches just need idx bubbled in
+        for (size_t p = path.size(); p-- > 0;) {
+            const RadixNode &n = nodes[path[p]];
+            if (n.cache != NIL && n.subtree > CACHE_CAP) promote(path[p], idx);
+            else refresh(path[p]);
+        }
+        return idx;
+    }
+
+    // Decrement a key's frequency, removing the entry when it reaches zero
+    bool remove(const string &norm) {
+        uint32_t v = find_exact(norm, path);
+        if (v == NIL || nodes[v].entry < 0) return false;
+        clone_path();
+        v = path.back();
+        int idx = nodes[v].entry;
+        Entry e = entries[idx];
+        retired.entries.push_back(idx);
+        if (e.freq > 1) {
+            e.freq -= 1;
+            e.last_ts = 0;
+            nodes[v].entry = new_entry(e);
+        } else {
+            // the key text stays behind; only the trie forgets the entry
+            nodes[v].entry = -1;
+            for (uint32_t p : path) nodes[p].subtree -= 1;
+            --live;
+        }
+        refresh_path();
+        return true;
+    }
+
+    // Best top_k live entries under v
+    void top_k(uint32_t v, int k, vector<int> &out) const {
+        out.clear();
+        if (v == NIL || k <= 0) return;
+        const RadixNode &n = nodes[v];
+        if (n.cache != NIL && (uint32_t)k <= CACHE_CAP) {
+            const int32_t *c = caches[n.cache].e;
+            out.assign(c, c + min<uint32_t>(k, n.cache_len));
             return;
         }
+        collect(v, out);
+        size_t keep = min<size_t>(k, out.size());
+        partial_sort(out.begin(), out.begin() + keep, out.end(),
+                     [this](int a, int b) { return better(a, b); });
+        out.resize(keep);
     }
-    cache.push_back(idx);
-    sort(cache.begin(), cache.end(), suggestion_cmp_idx);
-    if (cache.size() > MAX_CACHE_PER_NODE) cache.resize(MAX_CACHE_PER_NODE);
-}
 
-// --------------------------- Trie operations -------------------------------
+    // Entries under version root `from` having a key prefix within max_edits
+    // edits of q, closest first and by score within a distance; out holds
+    // (edits, entry) pairs.
+    void fuzzy_top_k(uint32_t from, const string &q, int max_edits, int k, vector<pair<int,int>> &out) const {
+        out.clear();
+        if (k <= 0 || max_edits < 0) return;
+        const uint32_t bound = (uint32_t)min(max_edits, 254);
+        const size_t m = q.size(), w = m + 1;
+        // one DP row per trie depth; no row deeper than m + bound + 1 can stay in bound
+        vector<uint8_t> rows((m + bound + 2) * w);
+        for (size_t j = 0; j <= m; ++j) rows[j] = (uint8_t)min<size_t>(j, bound + 1);
+        vector<FuzzyAnchor> anchors;
+        uint32_t dist = rows[m];
+        if (dist <= bound) anchors.push_back({from, dist, bound + 1});
+        if (m > 0) fuzzy_walk(q, bound, from, 0, dist, rows, anchors);
 
-TrieNode* make_node() {
-    TrieNode* node = new TrieNode();
-    return node;
-}
+        // Anchors for distance d cover every entry within d edits in disjoint
+        // subtrees. Buckets are filled in order, so when bucket d is reached
+        // everything closer is already in out and each anchor's top k by score
+        // is enough to find the best remaining ones.
+        vector<int> cand, top;
+        for (uint32_t d = 0; d <= bound && (int)out.size() < k; ++d) {
+            cand.clear();
+            for (const FuzzyAnchor &a : anchors) {
+                if (d < a.lo || d >= a.hi) continue;
+                top_k(a.node, k, top);
+                cand.insert(cand.end(), top.begin(), top.end());
+            }
+            sort(cand.begin(), cand.end(), [this](int a, int b) { return better(a, b); });
+            for (int idx : cand) {
+                if ((int)out.size() == k) break;
+                bool seen = false;
+                for (auto &o : out) seen |= o.second == idx;
+                if (!seen) out.emplace_back((int)d, idx);
+            }
+        }
+    }
 
-// Insert key into trie and update suggestion store; returns index in store
-int insert_suggestion(const string &raw_key, uint64_t timestamp = 0) {
-    string key = to_lower_normalize(raw_key);
-    lock_guard<std::mutex> lg(store_mutex);
-    int idx;
-    auto it = key_to_index.find(key);
-    if (it != key_to_index.end()) {
-        // exists -> increment freq and update ts
-        idx = it->second;
-        suggestion_store[idx].freq += 1;
-        suggestion_store[idx].last_ts = timestamp;
-    } else {
-        idx = (int)suggestion_store.size();
-        suggestion_store.push_back({raw_key, 1, timestamp});
-        key_to_index.emplace(key, idx);
-    }
-    // insert into trie and update caches along the path
-    TrieNode* node = root;
-    // lock-free traversal not safe for inserts; we will use node mutexes when updating
-    string norm = key;
-    for (char ch : norm) {
-        std::unique_lock<std::shared_mutex> lock(node->node_mutex);
-        TrieNode* next;
-        auto itc = node->children.find(ch);
-        if (itc == node->children.end()) {
-            next = make_node();
-            node->children[ch] = next;
-        } else next = itc->second;
-        // update cache at node
-        merge_into_cache(node->top_cache, idx);
-        lock.unlock();
-        node = next;
+    // Replace the contents with the rows of in. Keys are normalized in
+    // parallel and split by first character; each group is sorted and built
+    // on its own thread, then the finished subtrees are spliced under the root.
+    bool bulk_load(BulkInput &in, int threads) {
+        clear();
+        threads = max(1, threads);
+        const size_t n = in.size();
+        if (n >= (size_t)INT32_MAX) return false;
+        in.norm.assign(in.raw.size(), '\0');
+        in.norm_len.assign(n, 0);
+        {
+            atomic<size_t> next{0};
+            const size_t chunk = 4096;
+            vector<thread> pool;
+            for (int t = 0; t < threads; ++t) pool.emplace_back([&]() {
+                for (size_t lo; (lo = next.fetch_add(chunk)) < n;)
+                    for (size_t i = lo; i < min(n, lo + chunk); ++i)
+                        in.norm_len[i] = (uint32_t)normalize_into(in.raw.data() + in.start[i], in.start[i + 1] - in.start[i],
+                                                                  &in.norm[in.start[i]]);
+            });
+            for (auto &th : pool) th.join();
+        }
+
+        // group 0 holds the empty key, group 1 + c keys starting with byte c
+        vector<vector<uint32_t>> groups(257);
+        for (size_t i = 0; i < n; ++i) {
+            string_view k = in.norm_of(i);
+            groups[k.empty() ? 0 : 1 + (unsigned char)k[0]].push_back((uint32_t)i);
+        }
+        vector<size_t> order;
+        for (size_t g = 0; g < groups.size(); ++g) if (!groups[g].empty()) order.push_back(g);
+        sort(order.begin(), order.end(), [&](size_t a, size_t b) { return groups[a].size() > groups[b].size(); });
+        vector<RadixTrie> parts(groups.size());
+        {
+            atomic<size_t> next{0};
+            vector<thread> pool;
+            for (int t = 0; t < threads; ++t) pool.emplace_back([&]() {
+                for (size_t o; (o = next.fetch_add(1)) < order.size();) {
+                    vector<uint32_t> &rows = groups[order[o]];
+                    sort_rows(in, rows);
+                    parts[order[o]].build_sorted(in, rows);
+                    vector<uint32_t>().swap(rows);
+                }
+            });
+            for (auto &th : pool) th.join();
+        }
+        for (auto &p : parts) {
+            if (p.live == 0) continue;
+            if (!absorb(p)) return false;
+            p = RadixTrie();
+        }
+        refresh(root);
+        // the loaded trie is published whole; none of it is writable in place
+        fresh.assign(nodes.size(), 0);
+        vector<uint32_t>().swap(fresh_nodes);
+        return true;
     }
-    {
-        std::unique_lock<std::shared_mutex> lock(node->node_mutex);
-        node->is_end = true;
-        node->suggestion_indices.push_back(idx);
-        merge_into_cache(node->top_cache, idx);
+
+    // Retired records become garbage once the batch that unlinked them is published
+    void retire_batch() {
+        swap(limbo, retired);
+        retired.clear();
+        for (uint32_t v : fresh_nodes) fresh[v] = 0;
+        fresh_nodes.clear();
     }
-    return idx;
-}
 
-// Delete a suggestion (decrement frequency, optionally remove if freq==0)
-bool delete_suggestion(const string &raw_key) {
-    string key = to_lower_normalize(raw_key);
-    lock_guard<std::mutex> lg(store_mutex);
-    auto it = key_to_index.find(key);
-    if (it == key_to_index.end()) return false;
-    int idx = it->second;
-    // decrement frequency
-    if (suggestion_store[idx].freq > 1) {
-        suggestion_store[idx].freq -= 1;
-        suggestion_store[idx].last_ts = 0;
-        // Ideally update caches along path (we skip for simplicity)
+    // Recycle the last published batch's garbage. Only once no reader can
+    // still hold the version before it.
+    void reclaim() {
+        free_nodes.insert(free_nodes.end(), limbo.nodes.begin(), limbo.nodes.end());
+        free_caches.insert(free_caches.end(), limbo.caches.begin(), limbo.caches.end());
+        free_entries.insert(free_entries.end(), limbo.entries.begin(), limbo.entries.end());
+        for (auto &s : limbo.slots) free_slots[__builtin_ctz(s.second)].push_back(s.first);
+        limbo.clear();
+    }
+
+    size_t memory_bytes() const {
+        size_t b = nodes.memory_bytes() + labels.memory_bytes() + slots.memory_bytes()
+                 + caches.memory_bytes() + entries.memory_bytes() + key_text.memory_bytes();
+        for (auto &f : free_slots) b += f.capacity() * sizeof(uint32_t);
+        b += (free_nodes.capacity() + free_caches.capacity() + free_entries.capacity() + fresh_nodes.capacity())
+             * sizeof(uint32_t) + fresh.capacity();
+        return b + retired.memory_bytes() + limbo.memory_bytes();
+    }
+
+private:
+    struct FuzzyAnchor {
+        uint32_t node;
+        uint32_t lo, hi;   // the whole subtree is within d edits for lo <= d < hi
+    };
+
+    // Extend the DP below v, whose last row sits at depth and whose closest
+    // prefix so far is dist edits away. A child becomes an anchor when its
+    // label brings the distance below dist. Walking stops once the row minimum
+    // exceeds the bound or cannot beat the distance already reached, since
+    // deeper rows never have a smaller minimum.
+    void fuzzy_walk(const string &q, uint32_t bound, uint32_t v, size_t depth, uint32_t dist,
+                    vector<uint8_t> &rows, vector<FuzzyAnchor> &anchors) const {
+        const size_t m = q.size(), w = m + 1;
+        const RadixNode &n = nodes[v];
+        for (uint32_t s = 0; s < n.child_count; ++s) {
+            uint32_t c = slots[n.children + s].id;
+            const RadixNode &cn = nodes[c];
+            if (cn.subtree == 0) continue;
+            const char *label = labels.ptr(cn.label_pos);
+            uint32_t d = dist, rmin = 0;
+            uint32_t i = 0;
+            for (; i < cn.label_len; ++i) {
+                size_t r = depth + i + 1;
+                const uint8_t *prev = rows.data() + (r - 1) * w;
+                uint8_t *cur = rows.data() + r * w;
+                cur[0] = (uint8_t)min<size_t>(r, bound + 1);
+                rmin = cur[0];
+                for (size_t j = 1; j <= m; ++j) {
+                    uint32_t x = min<uint32_t>(prev[j], cur[j - 1]) + 1;
+                    x = min<uint32_t>(x, prev[j - 1] + (q[j - 1] != label[i]));
+                    cur[j] = (uint8_t)min<uint32_t>(x, bound + 1);
+                    rmin = min<uint32_t>(rmin, cur[j]);
+                }
+                d = min<uint32_t>(d, cur[m]);
+                if (rmin > bound || rmin >= d) break;
+            }
+            if (d < dist) anchors.push_back({c, d, dist});
+            if (i == cn.label_len && rmin <= bound && rmin < d)
+                fuzzy_walk(q, bound, c, depth + cn.label_len, d, rows, anchors);
+        }
+    }
+
+    // Sort rows by normalized key, ties in input order so duplicates keep
+    // their first raw key. Compares (first 16 bytes, row) records and only
+    // falls back to the strings when the heads agree.
+    static void sort_rows(const BulkInput &in, vector<uint32_t> &rows) {
+        struct Head { uint64_t hi, lo; uint32_t row; };
+        vector<Head> heads(rows.size());
+        for (size_t i = 0; i < rows.size(); ++i) {
+            string_view k = in.norm_of(rows[i]);
+            uint64_t h[2] = {0, 0};
+            for (size_t b = 0; b < 16; ++b) h[b / 8] = (h[b / 8] << 8) | (b < k.size() ? (unsigned char)k[b] : 0);
+            heads[i] = {h[0], h[1], rows[i]};
+        }
+        sort(heads.begin(), heads.end(), [&](const Head &a, const Head &b) {
+            if (a.hi != b.hi) return a.hi < b.hi;
+            if (a.lo != b.lo) return a.lo < b.lo;
+            int c = in.norm_of(a.row).compare(in.norm_of(b.row));
+            return c != 0 ? c < 0 : a.row < b.row;
+        });
+        for (size_t i = 0; i < rows.size(); ++i) rows[i] = heads[i].row;
+    }
+
+    // Build an empty trie from rows sorted by sort_rows in one left-to-right pass.
+    // The stack holds the rightmost path; a node is closed (child slots laid
+    // out exactly, cache merged from its finished children) as soon as a key
+    // diverges above it, so caches are produced bottom-up.
+    void build_sorted(const BulkInput &in, const vector<uint32_t> &rows) {
+        struct Frame { uint32_t node; size_t depth; size_t kids; };
+        vector<Frame> st{{root, 0, 0}};
+        vector<ChildSlot> kids;   // children of the open frames, innermost last
+        auto close = [&]() {
+            Frame f = st.back();
+            st.pop_back();
+            RadixNode &n = nodes[f.node];
+            uint32_t count = (uint32_t)(kids.size() - f.kids);
+            n.subtree = n.entry >= 0 ? 1 : 0;
+            if (count) {
+                uint32_t cap = 1;
+                while (cap < count) cap <<= 1;
+                n.children = alloc_slots(cap);
+                n.child_count = (uint16_t)count;
+                n.child_cap = (uint16_t)cap;
+                for (uint32_t s = 0; s < count; ++s) {
+                    slots[n.children + s] = kids[f.kids + s];
+                    n.subtree += nodes[kids[f.kids + s].id].subtree;
+                }
+                kids.resize(f.kids);
+            }
+            refresh(f.node);
+        };
+        string_view prev;
+        for (size_t i = 0; i < rows.size();) {
+            string_view k = in.norm_of(rows[i]);
+            size_t j = i + 1;
+            while (j < rows.size() && in.norm_of(rows[j]) == k) ++j;
+            size_t l = 0;
+            if (i > 0) {
+                size_t m = min(prev.size(), k.size());
+                while (l < m && prev[l] == k[l]) ++l;
+            }
+            while (st.size() > 1 && st[st.size() - 2].depth >= l) close();
+            if (st.back().depth > l) {
+                // k leaves the open edge partway: split it; the lower half is complete
+                uint32_t cut = (uint32_t)(l - st[st.size() - 2].depth);
+                uint32_t t = st.back().node;
+                uint32_t mid = new_node(nodes[t].label_pos, cut);
+                nodes[t].label_pos += cut;
+                nodes[t].label_len -= cut;
+                close();
+                kids.back().id = mid;
+                st.push_back({mid, l, kids.size()});
+                kids.push_back({labels[nodes[t].label_pos], t});
+            }
+            uint32_t v = st.back().node;
+            if (k.size() > l) {
+                v = new_node((uint32_t)labels.append(k.data() + l, k.size() - l), (uint32_t)(k.size() - l));
+                kids.push_back({k[l], v});
+                st.push_back({v, k.size(), kids.size()});
+            }
+            // duplicates fold into one entry: first raw key, last timestamp
+            string_view raw = in.raw_of(rows[i]);
+            nodes[v].entry = new_entry({key_text.append(raw.data(), raw.size()), (uint32_t)raw.size(),
+                                        (uint64_t)(j - i), in.ts[rows[j - 1]]});
+            ++live;
+            prev = k;
+            i = j;
+        }
+        while (!st.empty()) close();
+    }
+
+    // Copy a bulk-built part into our arenas and hang its subtrees off our
+    // root. Nodes, cache blocks and entries are appended in order, so their
+    // ids shift by a constant; labels, key text and child ranges are laid out
+    // again record by record.
+    bool absorb(const RadixTrie &part) {
+        if (nodes.size() + part.nodes.size() >= NIL || entries.size() + part.entries.size() >= (uint64_t)INT32_MAX)
+            return false;
+        uint32_t node_off = (uint32_t)nodes.size() - 1;  // part node x > 0 lands at x + node_off
+        uint32_t block_off = (uint32_t)caches.size();
+        int entry_off = (int)entries.size();
+        for (uint64_t b = 0; b < part.caches.size(); ++b) {
+            CacheBlock c = part.caches[b];
+            for (int32_t &e : c.e) e += entry_off;
+            caches.push_back(c);
+        }
+        for (uint64_t x = 0; x < part.entries.size(); ++x) {
+            Entry e = part.entries[x];
+            e.key_pos = key_text.append(part.key_text.ptr(e.key_pos), e.key_len);
+            entries.push_back(e);
+        }
+        for (uint32_t x = 1; x < part.nodes.size(); ++x) {
+            RadixNode n = part.nodes[x];
+            uint64_t pos = labels.append(part.labels.ptr(n.label_pos), n.label_len);
+            if (pos + n.label_len > UINT32_MAX) return false;
+            n.label_pos = (uint32_t)pos;
+            if (n.child_cap) {
+                uint32_t at = alloc_slots(n.child_cap);
+                for (uint32_t s = 0; s < n.child_count; ++s) {
+                    ChildSlot c = part.slots[n.children + s];
+                    slots[at + s] = {c.first, c.id + node_off};
+                }
+                n.children = at;
+            }
+            if (n.entry >= 0) n.entry += entry_off;
+            if (n.cache != NIL) n.cache += block_off;
+            nodes.push_back(n);
+        }
+        const RadixNode &pr = part.nodes[part.root];
+        for (uint32_t s = 0; s < pr.child_count; ++s) add_child(root, part.slots[pr.children + s].id + node_off);
+        if (pr.entry >= 0) nodes[root].entry = pr.entry + entry_off;
+        nodes[root].subtree += pr.subtree;
+        live += part.live;
         return true;
     }
-    // freq==1 -> remove suggestion entirely
-    suggestion_store[idx].freq = 0;
-    // mark removed; don't reindex suggestion_store to avoid reindexing costs
-    suggestion_store[idx].key = ""; // mark deleted
-    key_to_index.erase(it);
-    // Note: trie cleanup (removing nodes) is complex and optional;
-    // We'll leave nodes present but entries removed from suggestion_indices and caches lazily.
-    return true;
+
+    uint32_t new_node(uint32_t label_pos, uint32_t label_len) {
+        return push_node(RadixNode{label_pos, label_len, 0, 0, 0, -1, 0, NIL, 0});
+    }
+
+    uint32_t push_node(const RadixNode &n) {
+        uint32_t id;
+        if (free_nodes.empty()) id = (uint32_t)nodes.push_back(n);
+        else { id = free_nodes.back(); free_nodes.pop_back(); nodes[id] = n; }
+        if (fresh.size() <= id) fresh.resize(nodes.size());
+        fresh[id] = 1;
+        fresh_nodes.push_back(id);
+        return id;
+    }
+
+    int new_entry(const Entry &e) {
+        if (free_entries.empty()) return (int)entries.push_back(e);
+        int idx = free_entries.back();
+        free_entries.pop_back();
+        entries[idx] = e;
+        return idx;
+    }
+
+    uint32_t alloc_slots(uint32_t cap) {
+        auto &fl = free_slots[__builtin_ctz(cap)];
+        if (!fl.empty()) { uint32_t pos = fl.back(); fl.pop_back(); return pos; }
+        return (uint32_t)slots.alloc(cap);
+    }
+
+    uint32_t alloc_cache() {
+        if (free_caches.empty()) return (uint32_t)caches.alloc(1);
+        uint32_t b = free_caches.back();
+        free_caches.pop_back();
+        return b;
+    }
+
+    // Private copy of v with its own child range and cache block; v and its
+    // range and block are retired. The caller relinks the copy. A node made
+    // since the last publish is unseen by readers and is returned as is.
+    uint32_t clone(uint32_t v) {
+        if (fresh[v]) return v;
+        RadixNode n = nodes[v];
+        if (n.child_cap) {
+            uint32_t pos = alloc_slots(n.child_cap);
+            copy(slots.ptr(n.children), slots.ptr(n.children) + n.child_count, slots.ptr(pos));
+            retired.slots.push_back({n.children, n.child_cap});
+            n.children = pos;
+        }
+        if (n.cache != NIL) {
+            uint32_t b = alloc_cache();
+            caches[b] = caches[n.cache];
+            retired.caches.push_back(n.cache);
+            n.cache = b;
+        }
+        retired.nodes.push_back(v);
+        return push_node(n);
+    }
+
+    // Replace every node on path with a private copy, linked from a new root
+    void clone_path() {
+        for (size_t p = 0; p < path.size(); ++p) {
+            uint32_t copy = clone(path[p]);
+            if (p == 0) root = copy;
+            else replace_child(path[p - 1], path[p], copy);
+            path[p] = copy;
+        }
+    }
+
+    // v must be private to the writer (fresh from new_node or clone)
+    void add_child(uint32_t v, uint32_t c) {
+        RadixNode &n = nodes[v];
+        char ch = labels[nodes[c].label_pos];
+        if (n.child_count == n.child_cap) {
+            // grow by doubling; the old range is retired with its size class
+            uint16_t cap = n.child_cap ? n.child_cap * 2 : 1;
+            uint32_t pos = alloc_slots(cap);
+            for (uint32_t s = 0; s < n.child_count; ++s) slots[pos + s] = slots[n.children + s];
+            if (n.child_cap) retired.slots.push_back({n.children, n.child_cap});
+            n.children = pos;
+            n.child_cap = cap;
+        }
+        uint32_t at = n.child_count;
+        while (at > 0 && slots[n.children + at - 1].first > ch) {
+            slots[n.children + at] = slots[n.children + at - 1];
+            --at;
+        }
+        slots[n.children + at] = {ch, c};
+        ++n.child_count;
+    }
+
+    void replace_child(uint32_t v, uint32_t old_id, uint32_t new_id) {
+        const RadixNode &n = nodes[v];
+        for (uint32_t s = 0; s < n.child_count; ++s)
+            if (slots[n.children + s].id == old_id) { slots[n.children + s].id = new_id; return; }
+    }
+
+    // Append every live entry under v
+    void collect(uint32_t v, vector<int> &out) const {
+        const RadixNode &n = nodes[v];
+        if (n.subtree == 0) return;
+        if (n.entry >= 0) out.push_back(n.entry);
+        for (uint32_t s = 0; s < n.child_count; ++s) collect(slots[n.children + s].id, out);
+    }
+
+    // Recompute v's cache from its own entry and its children. A child either
+    // has a full cache of its best entries or holds at most CACHE_CAP entries,
+    // so the union of those is guaranteed to contain v's top CACHE_CAP. Cached
+    // children are already sorted runs; the node's own entry and the small
+    // children form one more, and the heads are k-way merged.
+    void refresh(uint32_t v) {
+        RadixNode &n = nodes[v];
+        if (n.subtree <= CACHE_CAP) {
+            if (n.cache != NIL) { retired.caches.push_back(n.cache); n.cache = NIL; n.cache_len = 0; }
+            return;
+        }
+        if (n.cache == NIL) n.cache = alloc_cache();
+        scratch.clear();
+        runs.clear();
+        if (n.entry >= 0) scratch.push_back(n.entry);
+        for (uint32_t s = 0; s < n.child_count; ++s) {
+            uint32_t c = slots[n.children + s].id;
+            const RadixNode &cn = nodes[c];
+            if (cn.cache != NIL) {
+                const int32_t *cc = caches[cn.cache].e;
+                runs.emplace_back(cc, cc + cn.cache_len);
+            } else collect(c, scratch);
+        }
+        sort(scratch.begin(), scratch.end(), [this](int a, int b) { return better(a, b); });
+        if (!scratch.empty()) runs.emplace_back(scratch.data(), scratch.data() + scratch.size());
+
+        auto worse_head = [this](const Run &a, const Run &b) { return better(*b.first, *a.first); };
+        make_heap(runs.begin(), runs.end(), worse_head);
+        int32_t *out = caches[n.cache].e;
+        uint32_t len = 0;
+        while (len < CACHE_CAP && !runs.empty()) {
+            pop_heap(runs.begin(), runs.end(), worse_head);
+            Run &r = runs.back();
+            out[len++] = *r.first++;
+            if (r.first == r.second) runs.pop_back();
+            else push_heap(runs.begin(), runs.end(), worse_head);
+        }
+        n.cache_len = len;
+    }
+
+    // Move idx to its rank in v's cache after its score increased, taking
+    // the last slot if it was not cached yet and beats the current worst
+    void promote(uint32_t v, int idx) {
+        RadixNode &n = nodes[v];
+        int32_t *c = caches[n.cache].e;
+        uint32_t pos = 0;
+        while (pos < n.cache_len && c[pos] != idx) ++pos;
+        if (pos == n.cache_len) {
+            if (n.cache_len < CACHE_CAP) ++n.cache_len;
+            else if (!better(idx, c[pos - 1])) return;
+            pos = n.cache_len - 1;
+        }
+        while (pos > 0 && better(idx, c[pos - 1])) { c[pos] = c[pos - 1]; --pos; }
+        c[pos] = idx;
+    }
+
+    // Caches along the last written path, deepest node first
+    void refresh_path() {
+        for (size_t p = path.size(); p-- > 0;) refresh(path[p]);
+    }
+};
+
+// --------------------------- Snapshots (epoch-based) ---------------------
+//
+// Readers never lock. They announce the global epoch in a per-thread slot,
+// load the current version and traverse it. A version is a root id into the
+// shared arenas, and nothing reachable from a published root is written
+// again. Writers queue inserts and deletes and publish them in batches: the
+// batch is applied by path copying, the new root is swapped in atomically and
+// the epoch advanced. Each publish leaves one copy of the trie plus the
+// records its batch unlinked; those are recycled just before the next batch,
+// once every reader that could still see them has left (the grace period).
+// Queued ops are published when UPDATE_BATCH have piled up, or by a
+// background thread once the oldest has waited PUBLISH_DELAY.
+
+struct TrieOp {
+    bool insert;     // false = delete
+    string norm;
+    string raw;
+    uint64_t ts;
+};
+
+static const uint64_t EPOCH_IDLE = UINT64_MAX;
+static const size_t MAX_READERS = 256;
+static const size_t UPDATE_BATCH = 4096;                          // queued ops that trigger a publish
+static const chrono::milliseconds PUBLISH_DELAY{50};              // longest an op stays queued
+
+struct alignas(64) ReaderSlot {
+    atomic<uint64_t> epoch{EPOCH_IDLE};  // epoch the reader entered in, or idle
+    atomic<bool> taken{false};
+};
+
+RadixTrie trie_store;                  // shared by every version; written under writer_mutex
+atomic<uint64_t> current_version{0};   // live entries << 32 | root id
+atomic<uint64_t> global_epoch{1};
+ReaderSlot reader_slots[MAX_READERS];
+
+std::mutex writer_mutex;       // guards everything below
+vector<TrieOp> pending_ops;    // queued, not yet visible
+chrono::steady_clock::time_point pending_since;   // when the oldest queued op arrived
+condition_variable pending_cv;
+uint64_t limbo_retired = 0;    // epoch in which trie_store.limbo was unlinked
+atomic<uint64_t> published_batches{0};
+
+// A thread claims a reader slot on its first query and frees it on exit
+struct ReaderSlotOwner {
+    ReaderSlot *slot = nullptr;
+    ReaderSlotOwner() {
+        while (!slot) {
+            for (auto &rs : reader_slots) {
+                bool expected = false;
+                if (rs.taken.compare_exchange_strong(expected, true)) { slot = &rs; break; }
+            }
+            if (!slot) this_thread::yield();
+        }
+    }
+    ~ReaderSlotOwner() { slot->taken.store(false); }
+};
+
+// Pins the current version for the guard's lifetime. Not reentrant: one
+// guard per thread at a time.
+struct ReadGuard {
+    ReaderSlot &slot;
+    const RadixTrie *trie = &trie_store;
+    uint32_t root;
+    size_t live;
+    ReadGuard() : slot(reader_slot()) {
+        // announce before loading the version; both seq_cst, see publish_updates
+        slot.epoch.store(global_epoch.load());
+        uint64_t v = current_version.load();
+        root = (uint32_t)v;
+        live = v >> 32;
+    }
+    ~ReadGuard() { slot.epoch.store(EPOCH_IDLE, memory_order_release); }
+    static ReaderSlot &reader_slot() {
+        thread_local ReaderSlotOwner owner;
+        return *owner.slot;
+    }
+};
+
+// Wait until no reader is inside an epoch <= e
+void wait_for_readers(uint64_t e) {
+    for (auto &rs : reader_slots)
+        while (rs.epoch.load() <= e) this_thread::yield();
 }
 
-// Find node corresponding to prefix (normalized), return nullptr if not found
-TrieNode* find_node_for_prefix(const string &prefix) {
-    TrieNode* node = root;
-    string norm = to_lower_normalize(prefix);
-    for (char ch : norm) {
-        std::shared_lock<std::shared_mutex> lock(node->node_mutex);
-        auto it = node->children.find(ch);
-        if (it == node->children.end()) return nullptr;
-        node = it->second;
+void apply_ops(RadixTrie &t, const vector<TrieOp> &ops) {
+    for (const TrieOp &op : ops) {
+        if (op.insert) t.upsert(op.norm, op.raw, op.ts);
+        else t.remove(op.norm);
     }
-    return node;
 }
 
-// Gather top suggestions under node using cache, fallback to DFS if necessary
-vector<int> gather_top_suggestions(TrieNode* node, int top_k) {
-    vector<int> result;
-    if (!node) return result;
-    { // try using cache
-        std::shared_lock<std::shared_mutex> lock(node->node_mutex);
-        for (int idx : node->top_cache) {
-            // filter out deleted entries
-            if (idx >= 0 && idx < (int)suggestion_store.size() && !suggestion_store[idx].key.empty()) {
-                result.push_back(idx);
-                if ((int)result.size() >= top_k) break;
+// Make every queued op visible; returns how many were published
+size_t publish_updates() {
+    lock_guard<std::mutex> lg(writer_mutex);
+    if (pending_ops.empty()) return 0;
+    // grace period: a reader that could reach the limbo records entered in an
+    // epoch <= limbo_retired. One that entered later read global_epoch after
+    // that increment, which followed the root swap, so it holds a newer root.
+    wait_for_readers(limbo_retired);
+    trie_store.reclaim();
+    apply_ops(trie_store, pending_ops);
+    current_version.store((uint64_t)trie_store.live << 32 | trie_store.root);
+    limbo_retired = global_epoch.fetch_add(1);
+    trie_store.retire_batch();
+    size_t n = pending_ops.size();
+    pending_ops.clear();
+    published_batches.fetch_add(1, memory_order_relaxed);
+    return n;
+}
+
+// Publishes queued ops once the oldest has waited PUBLISH_DELAY, so writes
+// show up even when the writer goes quiet before a batch fills. Started by
+// the first queued op.
+struct DelayedPublisher {
+    thread worker;
+    bool stop = false;   // guarded by writer_mutex
+
+    void start() {
+        worker = thread([this]() {
+            unique_lock<std::mutex> lk(writer_mutex);
+            while (!stop) {
+                if (pending_ops.empty()) pending_cv.wait(lk);
+                else if (chrono::steady_clock::now() < pending_since + PUBLISH_DELAY)
+                    pending_cv.wait_until(lk, pending_since + PUBLISH_DELAY);
+                else { lk.unlock(); publish_updates(); lk.lock(); }
             }
+        });
+    }
+    ~DelayedPublisher() {
+        if (!worker.joinable()) return;
+        { lock_guard<std::mutex> lg(writer_mutex); stop = true; }
+        pending_cv.notify_all();
+        worker.join();
+    }
+};
+DelayedPublisher delayed_publisher;
+
+// Replace the trie with a bulk-built one. Call before readers start.
+bool install_bulk(BulkInput &rows, int threads) {
+    lock_guard<std::mutex> lg(writer_mutex);
+    if (!trie_store.bulk_load(rows, threads)) return false;
+    // nobody can hold records from before the load
+    trie_store.retire_batch();
+    trie_store.reclaim();
+    current_version.store((uint64_t)trie_store.live << 32 | trie_store.root);
+    pending_ops.clear();
+    limbo_retired = global_epoch.fetch_add(1);
+    return true;
+}
+
+// --------------------------- Trie operations -------------------------------
+
+void queue_op(TrieOp op) {
+    bool full;
+    {
+        lock_guard<std::mutex> lg(writer_mutex);
+        if (!delayed_publisher.worker.joinable()) delayed_publisher.start();
+        if (pending_ops.empty()) {
+            pending_since = chrono::steady_clock::now();
+            pending_cv.notify_all();
         }
-        if ((int)result.size() >= top_k) return result;
-    }
-    // Cache insufficient -> do DFS to find more suggestions
-    // BFS traversal collecting suggestion indices and using priority by score
-    priority_queue<int, vector<int>, function<bool(int,int)>> pq(
-        [](int a, int b){ return suggestion_cmp_idx(a,b); } // not used but prepare
-    );
-    // we'll use a vector and then sort
-    vector<int> found;
-    // BFS queue
-    deque<TrieNode*> q;
-    q.push_back(node);
-    while (!q.empty() && (int)found.size() < top_k*5) { // limit exploration to avoid heavy work
-        TrieNode* cur = q.front(); q.pop_front();
-        std::shared_lock<std::shared_mutex> lock(cur->node_mutex);
-        // add end suggestions
-        for (int idx : cur->suggestion_indices) {
-            if (idx >= 0 && idx < (int)suggestion_store.size() && !suggestion_store[idx].key.empty())
-                found.push_back(idx);
-        }
-        for (auto &p : cur->children) q.push_back(p.second);
-    }
-    // sort found by score and pick top_k
-    sort(found.begin(), found.end(), suggestion_cmp_idx);
-    for (int i = 0; i < (int)found.size() && (int)result.size() < top_k; ++i) {
-        result.push_back(found[i]);
+        pending_ops.push_back(std::move(op));
+        full = pending_ops.size() >= UPDATE_BATCH;
     }
+    if (full) publish_updates();
+}
+
+// Queue an insert (or frequency bump) of key. It becomes visible with the
+// next publish: at once when UPDATE_BATCH ops are queued, otherwise within
+// PUBLISH_DELAY; call publish_updates() to make it visible immediately.
+void insert_suggestion(const string &raw_key, uint64_t timestamp = 0) {
+    queue_op({true, to_lower_normalize(raw_key), raw_key, timestamp});
+}
+
+// Queue a delete (decrement frequency, remove it once freq reaches 0);
+// published like insert_suggestion
+void delete_suggestion(const string &raw_key) {
+    queue_op({false, to_lower_normalize(raw_key), string(), 0});
+}
+
+// Find node corresponding to prefix (normalized), NIL if not found
+uint32_t find_node_for_prefix(const RadixTrie &t, uint32_t root, const string &prefix) {
+    return t.find_prefix(root, to_lower_normalize(prefix));
+}
+
+// Gather top suggestions under node from its cache, enumerating the subtree
+// when it is small or top_k exceeds the cache
+vector<int> gather_top_suggestions(const RadixTrie &t, uint32_t node, int top_k) {
+    vector<int> result;
+    t.top_k(node, top_k, result);
     return result;
 }
 
+Suggestion make_suggestion(const RadixTrie &t, int idx) {
+    const Entry &e = t.entries[idx];
+    return {string(t.key_of(idx)), e.freq, e.last_ts};
+}
+
 // Autocomplete API: returns vector of suggestion strings (top_k)
 vector<Suggestion> autocomplete(const string &prefix, int top_k) {
     vector<Suggestion> out;
-    TrieNode* node = find_node_for_prefix(prefix);
-    if (!node) return out;
-    vector<int> idxs = gather_top_suggestions(node, top_k);
+    ReadGuard g;
+    uint32_t node = find_node_for_prefix(*g.trie, g.root, prefix);
+    if (node == NIL) return out;
+    vector<int> idxs = gather_top_suggestions(*g.trie, node, top_k);
     for (int idx : idxs) {
-        out.push_back(suggestion_store[idx]);
+        out.push_back(make_suggestion(*g.trie, idx));
     }
     return out;
 }
 
 // --------------------------- CSV Loading ----------------------------------
 
-bool load_csv_and_build_trie(const string &filename) {
+// Reads every row first and bulk-loads the trie; use
+// insert_suggestion for incremental updates afterwards.
+bool load_csv_and_build_trie(const string &filename, int threads = (int)thread::hardware_concurrency()) {
     ifstream fin(filename);
     if (!fin.is_open()) {
         cerr << "Cannot open file: " << filename << "\n";
@@ -288,74 +1106,110 @@ bool load_csv_and_build_trie(const string &filename) {
     // simple parse: expect columns id,name,address
     string line;
     int line_no = 1;
+    BulkInput rows;
     while (getline(fin, line)) {
         ++line_no;
         if (line.empty()) continue;
         // naive split into 3 columns - handle commas in address by splitting first two commas
-        vector<string> parts;
-        parts.reserve(3);
-        string cur;
-        int commas = 0;
-        for (char ch : line) {
-            if (ch == ',' && commas < 2) { parts.push_back(cur); cur.clear(); ++commas; }
-            else cur.push_back(ch);
-        }
-        parts.push_back(cur);
-        for (auto &p : parts) { trim(p); }
-        if (parts.size() < 3) continue;
-        string id = parts[0];
-        string name = parts[1];
-        string address = parts[2];
+        size_t c1 = line.find(',');
+        size_t c2 = c1 == string::npos ? string::npos : line.find(',', c1 + 1);
+        if (c2 == string::npos) continue;
+        string name = line.substr(c1 + 1, c2 - c1 - 1);
+        string address = line.substr(c2 + 1);
+        trim(name);
+        trim(address);
         string key = name + ", " + address;
         // use current timestamp as index (monotonic)
         uint64_t ts = (uint64_t)time(nullptr);
-        insert_suggestion(key, ts);
+        rows.add(key, ts);
     }
     fin.close();
+    if (!install_bulk(rows, threads)) {
+        cerr << "Too many keys for 32-bit trie arenas\n";
+        return false;
+    }
     return true;
 }
 
-// --------------------------- Levenshtein (simple fallback) -----------------
-
-int levenshtein(const string &a, const string &b) {
-    int n = a.size(), m = b.size();
-    vector<int> dp(m+1);
-    for (int j=0;j<=m;++j) dp[j]=j;
-    for (int i=1;i<=n;++i) {
-        int prev = dp[0];
-        dp[0] = i;
-        for (int j=1;j<=m;++j) {
-            int cur = dp[j];
-            int cost = (a[i-1]==b[j-1]) ? 0 : 1;
-            dp[j] = min({ dp[j]+1, dp[j-1]+1, prev + cost });
-            prev = cur;
-        }
-    }
-    return dp[m];
-}
+// --------------------------- Fuzzy search ---------------------------------
 
-// Fuzzy fallback: scan all suggestions and return those with small edit distance (only for small datasets)
-vector<Suggestion> fuzzy_suggest(const string &prefix, int top_k) {
+// Fuzzy fallback: entries whose key starts within max_edits edits of the
+// prefix, fewest edits first
+vector<Suggestion> fuzzy_suggest(const string &prefix, int top_k, int max_edits = 2) {
     string norm = to_lower_normalize(prefix);
-    vector<pair<int,int>> candidates; // distance, idx
-    for (int i=0;i<(int)suggestion_store.size();++i) {
-        if (suggestion_store[i].key.empty()) continue;
-        string k = to_lower_normalize(suggestion_store[i].key);
-        int d = levenshtein(norm, k.substr(0, min((int)k.size(), (int)norm.size()+2)));
-        candidates.emplace_back(d, i);
-    }
-    sort(candidates.begin(), candidates.end());
+    ReadGuard g;
+    vector<pair<int,int>> hits; // distance, idx
+    g.trie->fuzzy_top_k(g.root, norm, max_edits, top_k, hits);
     vector<Suggestion> out;
-    for (int i=0;i<(int)candidates.size() && (int)out.size()<top_k; ++i) {
-        out.push_back(suggestion_store[candidates[i].second]);
-    }
+    for (auto &h : hits) out.push_back(make_suggestion(*g.trie, h.second));
     return out;
 }
 
+// --------------------------- Benchmark ------------------------------------
+
+// Query throughput for 1, 2, 4, ... max_threads readers, first alone and
+// then next to a writer that keeps bumping random keys (publishing every
+// UPDATE_BATCH ops). Prefixes are cut at random lengths from stored keys.
+void run_benchmark(int max_threads, double seconds, int top_k) {
+    vector<string> raws, prefixes;
+    {
+        ReadGuard g;
+        const RadixTrie &t = *g.trie;
+        if (g.live == 0) return;
+        mt19937 rng(12345);
+        for (int i = 0; i < 100000; ++i) {
+            string raw(t.key_of(rng() % t.entries.size()));
+            string norm = to_lower_normalize(raw);
+            prefixes.push_back(norm.substr(0, 1 + rng() % max<size_t>(1, min<size_t>(norm.size(), 16))));
+            raws.push_back(std::move(raw));
+        }
+    }
+    cout << "Benchmark: " << prefixes.size() << " prefixes, top " << top_k << ", "
+         << seconds << " s per run\n";
+    cout << "threads  writer  queries/s      publishes/s\n";
+    vector<int> counts;
+    for (int th = 1; th < max_threads; th *= 2) counts.push_back(th);
+    counts.push_back(max_threads);
+    for (int with_writer = 0; with_writer < 2; ++with_writer) {
+        for (int th : counts) {
+            atomic<bool> stop{false};
+            atomic<uint64_t> queries{0};
+            uint64_t batches0 = published_batches.load();
+            vector<thread> pool;
+            for (int t = 0; t < th; ++t) pool.emplace_back([&, t]() {
+                uint64_t n = 0;
+                size_t i = (size_t)t * 7919;
+                while (!stop.load(memory_order_relaxed)) {
+                    autocomplete(prefixes[i++ % prefixes.size()], top_k);
+                    ++n;
+                }
+                queries.fetch_add(n);
+            });
+            thread writer;
+            if (with_writer) writer = thread([&]() {
+                mt19937 rng(99);
+                uint64_t ts = (uint64_t)time(nullptr);
+                while (!stop.load(memory_order_relaxed)) insert_suggestion(raws[rng() % raws.size()], ++ts);
+            });
+            auto t0 = chrono::steady_clock::now();
+            this_thread::sleep_for(chrono::duration<double>(seconds));
+            stop.store(true);
+            for (auto &p : pool) p.join();
+            if (writer.joinable()) writer.join();
+            double el = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+            cout << setw(7) << th << "  " << setw(6) << (with_writer ? "yes" : "no") << "  "
+                 << setw(13) << fixed << setprecision(0) << queries.load() / el << "  "
+                 << setw(11) << setprecision(1) << (published_batches.load() - batches0) / el << "\n";
+        }
+    }
+    publish_updates();
+}
+
 // --------------------------- Main (CLI) -----------------------------------
 
 void print_usage() {
-    cerr << "Usage: autocomplete_trie data.csv [--top K] [--fuzzy]\n";
+    cerr << "Usage: autocomplete_trie data.csv [--top K] [--fuzzy] [--max-edits D] [--threads N]\n";
+    cerr << "       autocomplete_trie data.csv --bench READERS [--bench-seconds S] [--top K]\n";
     cerr << "Then type prefixes interactively to get suggestions (type exit to quit).\n";
 }
 
@@ -367,21 +1221,37 @@ int main(int argc, char** argv) {
     string datafile = argv[1];
     int top_k = 5;
     bool fuzzy = false;
+    int max_edits = 2;
+    int threads = max(1u, thread::hardware_concurrency());
+    int bench_threads = 0;
+    double bench_seconds = 1.0;
     for (int i=2;i<argc;++i) {
         string s = argv[i];
         if (s == "--top" && i+1<argc) top_k = stoi(argv[++i]);
         else if (s == "--fuzzy") fuzzy = true;
+        else if (s == "--max-edits" && i+1<argc) max_edits = max(0, stoi(argv[++i]));
+        else if (s == "--threads" && i+1<argc) threads = max(1, stoi(argv[++i]));
+        else if (s == "--bench" && i+1<argc) bench_threads = max(1, stoi(argv[++i]));
+        else if (s == "--bench-seconds" && i+1<argc) bench_seconds = stod(argv[++i]);
     }
 
-    // Initialize root
-    root = make_node();
-
     cout << "Loading data from " << datafile << " ...\n";
-    if (!load_csv_and_build_trie(datafile)) {
+    auto t0 = chrono::steady_clock::now();
+    if (!load_csv_and_build_trie(datafile, threads)) {
         cerr << "Failed to load CSV\n";
         return 1;
     }
-    cout << "Loaded " << suggestion_store.size() << " suggestions into trie.\n";
+    {
+        ReadGuard g;
+        cout << "Loaded " << g.live << " suggestions into trie.\n";
+        cout << "Trie: " << g.trie->nodes.size() << " nodes, "
+             << fixed << setprecision(1) << g.trie->memory_bytes() / 1048576.0 << " MB, built in "
+             << setprecision(2) << chrono::duration<double>(chrono::steady_clock::now() - t0).count() << " s\n";
+    }
+    if (bench_threads > 0) {
+        run_benchmark(bench_threads, bench_seconds, top_k);
+        return 0;
+    }
     cout << "Ready. Enter prefix queries (type 'exit' or blank line to quit).\n";
 
     string line;
@@ -394,7 +1264,7 @@ int main(int argc, char** argv) {
         // if user types a number to select suggestion, not implemented here
         auto suggestions = autocomplete(line, top_k);
         if (suggestions.empty() && fuzzy) {
-            auto f = fuzzy_suggest(line, top_k);
+            auto f = fuzzy_suggest(line, top_k, max_edits);
             if (!f.empty()) {
                 cout << "Fuzzy suggestions:\n";
                 for (auto &s : f) cout << "  " << s.key << "  (freq=" << s.freq << ")\n";